@@ -0,0 +1,353 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "MockDriver.hpp"
+
+#include <functional>
+#include <iostream>
+#include <chrono>
+#include <iomanip>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+using namespace std;
+
+/*
+    Measures per-call overhead of the layer on top of the mock driver.
+
+    Every thread owns its queue and swapchain (as required by Vulkan external synchronization),
+    so only the layer's own synchronization is measured. Frame limiting is not expected to be
+    enabled here, run with "VK_LAYER_FLIMES_FRAMERATE" unset.
+
+    "frames" mode runs a render loop with simulated frame work and prints the framerate every
+    second, it exercises the frame limiter, external control and coordinator end to end.
+*/
+
+extern "C" PFN_vkVoidFunction VKAPI_CALL vkGetInstanceProcAddrFlimes(VkInstance instance, const char *pName);
+extern "C" PFN_vkVoidFunction VKAPI_CALL vkGetDeviceProcAddrFlimes(VkDevice device, const char *pName);
+
+constexpr uint32_t g_maxThreads = 64;
+
+struct Layer
+{
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue queues[g_maxThreads] = {};
+    VkSwapchainKHR swapchains[g_maxThreads] = {};
+    VkCommandBuffer commandBuffers[g_maxThreads] = {};
+
+    PFN_vkDestroyInstance destroyInstance = nullptr;
+    PFN_vkDestroyDevice destroyDevice = nullptr;
+    PFN_vkCreateSampler createSampler = nullptr;
+    PFN_vkDestroySampler destroySampler = nullptr;
+    PFN_vkCreateSwapchainKHR createSwapchainKHR = nullptr;
+    PFN_vkDestroySwapchainKHR destroySwapchainKHR = nullptr;
+    PFN_vkAcquireNextImageKHR acquireNextImageKHR = nullptr;
+    PFN_vkQueuePresentKHR queuePresentKHR = nullptr;
+    PFN_vkCmdDraw cmdDraw = nullptr;
+};
+
+template<typename T>
+static T getInstanceProc(VkInstance instance, const char *name)
+{
+    auto fn = reinterpret_cast<T>(vkGetInstanceProcAddrFlimes(instance, name));
+    if (!fn)
+    {
+        cerr << "Layer doesn't provide " << name << endl;
+        exit(1);
+    }
+    return fn;
+}
+template<typename T>
+static T getDeviceProc(VkDevice device, const char *name)
+{
+    auto fn = reinterpret_cast<T>(vkGetDeviceProcAddrFlimes(device, name));
+    if (!fn)
+    {
+        cerr << "Layer doesn't provide " << name << endl;
+        exit(1);
+    }
+    return fn;
+}
+
+static bool createLayer(Layer &layer)
+{
+    // Instance, the loader passes the next layer via VkLayerInstanceCreateInfo
+    VkLayerInstanceLink instanceLink = {};
+    instanceLink.pfnNextGetInstanceProcAddr = MockDriver::getInstanceProcAddr;
+
+    VkLayerInstanceCreateInfo layerInstanceInfo = {};
+    layerInstanceInfo.sType = VK_STRUCTURE_TYPE_LOADER_INSTANCE_CREATE_INFO;
+    layerInstanceInfo.function = VK_LAYER_LINK_INFO;
+    layerInstanceInfo.u.pLayerInfo = &instanceLink;
+
+    VkInstanceCreateInfo instanceInfo = {};
+    instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceInfo.pNext = &layerInstanceInfo;
+
+    auto createInstance = getInstanceProc<PFN_vkCreateInstance>(VK_NULL_HANDLE, "vkCreateInstance");
+    if (createInstance(&instanceInfo, nullptr, &layer.instance) != VK_SUCCESS)
+        return false;
+
+    layer.destroyInstance = getInstanceProc<PFN_vkDestroyInstance>(layer.instance, "vkDestroyInstance");
+
+    // Physical devices aren't intercepted by the layer
+    auto enumeratePhysicalDevices = reinterpret_cast<PFN_vkEnumeratePhysicalDevices>(MockDriver::getInstanceProcAddr(layer.instance, "vkEnumeratePhysicalDevices"));
+    uint32_t physicalDeviceCount = 1;
+    if (enumeratePhysicalDevices(layer.instance, &physicalDeviceCount, &layer.physicalDevice) != VK_SUCCESS || physicalDeviceCount != 1)
+        return false;
+
+    // Device
+    VkLayerDeviceLink deviceLink = {};
+    deviceLink.pfnNextGetInstanceProcAddr = MockDriver::getInstanceProcAddr;
+    deviceLink.pfnNextGetDeviceProcAddr = MockDriver::getDeviceProcAddr;
+
+    VkLayerDeviceCreateInfo layerDeviceInfo = {};
+    layerDeviceInfo.sType = VK_STRUCTURE_TYPE_LOADER_DEVICE_CREATE_INFO;
+    layerDeviceInfo.function = VK_LAYER_LINK_INFO;
+    layerDeviceInfo.u.pLayerInfo = &deviceLink;
+
+    const vector<float> queuePriorities(g_maxThreads, 1.0f);
+
+    VkDeviceQueueCreateInfo queueInfo = {};
+    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfo.queueCount = g_maxThreads;
+    queueInfo.pQueuePriorities = queuePriorities.data();
+
+    VkDeviceCreateInfo deviceInfo = {};
+    deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceInfo.pNext = &layerDeviceInfo;
+    deviceInfo.queueCreateInfoCount = 1;
+    deviceInfo.pQueueCreateInfos = &queueInfo;
+
+    auto createDevice = getInstanceProc<PFN_vkCreateDevice>(layer.instance, "vkCreateDevice");
+    if (createDevice(layer.physicalDevice, &deviceInfo, nullptr, &layer.device) != VK_SUCCESS)
+        return false;
+
+    layer.destroyDevice = getDeviceProc<PFN_vkDestroyDevice>(layer.device, "vkDestroyDevice");
+    layer.createSampler = getDeviceProc<PFN_vkCreateSampler>(layer.device, "vkCreateSampler");
+    layer.destroySampler = getDeviceProc<PFN_vkDestroySampler>(layer.device, "vkDestroySampler"); // not hooked unless "VK_LAYER_FLIMES_SAMPLER_CACHE" is set
+    layer.createSwapchainKHR = getDeviceProc<PFN_vkCreateSwapchainKHR>(layer.device, "vkCreateSwapchainKHR");
+    layer.destroySwapchainKHR = getDeviceProc<PFN_vkDestroySwapchainKHR>(layer.device, "vkDestroySwapchainKHR");
+    layer.acquireNextImageKHR = getDeviceProc<PFN_vkAcquireNextImageKHR>(layer.device, "vkAcquireNextImageKHR");
+    layer.queuePresentKHR = getDeviceProc<PFN_vkQueuePresentKHR>(layer.device, "vkQueuePresentKHR");
+    layer.cmdDraw = getDeviceProc<PFN_vkCmdDraw>(layer.device, "vkCmdDraw"); // not hooked unless "VK_LAYER_FLIMES_DRAW_COUNTERS" is set
+
+    // Queues, command buffers and swapchains, one per thread
+    for (uint32_t i = 0; i < g_maxThreads; ++i)
+    {
+        MockDriver::getDeviceQueue(layer.device, 0, i, &layer.queues[i]);
+        layer.commandBuffers[i] = MockDriver::allocateCommandBuffer(layer.device);
+
+        VkSwapchainCreateInfoKHR swapchainInfo = {};
+        swapchainInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        swapchainInfo.minImageCount = 3;
+        swapchainInfo.imageExtent = {1920, 1080};
+        swapchainInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        if (layer.createSwapchainKHR(layer.device, &swapchainInfo, nullptr, &layer.swapchains[i]) != VK_SUCCESS)
+            return false;
+    }
+
+    return true;
+}
+static void destroyLayer(Layer &layer)
+{
+    for (auto swapchain : layer.swapchains)
+    {
+        if (swapchain != VK_NULL_HANDLE)
+            layer.destroySwapchainKHR(layer.device, swapchain, nullptr);
+    }
+    if (layer.device != VK_NULL_HANDLE)
+        layer.destroyDevice(layer.device, nullptr);
+    if (layer.instance != VK_NULL_HANDLE)
+        layer.destroyInstance(layer.instance, nullptr);
+}
+
+static int64_t threadCpuTimeNs()
+{
+    timespec ts = {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+// Returns average CPU time per call in nanoseconds
+static double measure(uint32_t nThreads, uint32_t iterations, const function<void(uint32_t idx)> &fn)
+{
+    vector<int64_t> cpuTimes(nThreads);
+    vector<thread> threads;
+    threads.reserve(nThreads);
+
+    for (uint32_t t = 0; t < nThreads; ++t)
+    {
+        threads.emplace_back([&, t] {
+            const auto start = threadCpuTimeNs();
+            for (uint32_t i = 0; i < iterations; ++i)
+                fn(t);
+            cpuTimes[t] = threadCpuTimeNs() - start;
+        });
+    }
+    for (auto &&t : threads)
+        t.join();
+
+    int64_t total = 0;
+    for (auto cpuTime : cpuTimes)
+        total += cpuTime;
+    return static_cast<double>(total) / (static_cast<double>(nThreads) * iterations);
+}
+
+static int runFrames(Layer &layer, const double seconds, const chrono::microseconds workTime)
+{
+    using clock = chrono::steady_clock;
+
+    const auto end = clock::now() + chrono::duration_cast<clock::duration>(chrono::duration<double>(seconds));
+    auto reportTime = clock::now();
+    uint32_t frames = 0;
+
+    while (clock::now() < end)
+    {
+        uint32_t imageIndex = 0;
+        layer.acquireNextImageKHR(layer.device, layer.swapchains[0], UINT64_MAX, VK_NULL_HANDLE, VK_NULL_HANDLE, &imageIndex);
+
+        const auto workEnd = clock::now() + workTime;
+        while (clock::now() < workEnd)
+        {
+        }
+
+        VkPresentInfoKHR presentInfo = {};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &layer.swapchains[0];
+        presentInfo.pImageIndices = &imageIndex;
+        layer.queuePresentKHR(layer.queues[0], &presentInfo);
+
+        ++frames;
+
+        const auto now = clock::now();
+        if (now - reportTime >= chrono::seconds(1))
+        {
+            cout << fixed << setprecision(1) << frames / chrono::duration<double>(now - reportTime).count() << " FPS" << endl;
+            reportTime = now;
+            frames = 0;
+        }
+    }
+
+    destroyLayer(layer);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "frames") == 0)
+    {
+        const double seconds = (argc > 2) ? atof(argv[2]) : 10.0;
+        const auto workTime = chrono::microseconds((argc > 3) ? atoi(argv[3]) : 1000);
+
+        Layer layer;
+        if (!createLayer(layer))
+        {
+            cerr << "Can't initialize layer on mock driver" << endl;
+            destroyLayer(layer);
+            return 1;
+        }
+        return runFrames(layer, seconds, workTime);
+    }
+
+    // Defaults sweep 1, 2, 4, ... 64 threads and finish in seconds, more iterations give more stable numbers
+    uint32_t iterations = 20000;
+    uint32_t maxThreads = g_maxThreads;
+    if (argc > 1)
+        iterations = max(1, atoi(argv[1]));
+    if (argc > 2)
+        maxThreads = clamp<uint32_t>(atoi(argv[2]), 1, g_maxThreads);
+
+    Layer layer;
+    if (!createLayer(layer))
+    {
+        cerr << "Can't initialize layer on mock driver" << endl;
+        destroyLayer(layer);
+        return 1;
+    }
+
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    // Keeps the shared sampler alive, so "createSampler" measures cache hits with "VK_LAYER_FLIMES_SAMPLER_CACHE"
+    VkSampler sharedSampler = VK_NULL_HANDLE;
+    layer.createSampler(layer.device, &samplerInfo, nullptr, &sharedSampler);
+
+    const vector<pair<const char *, function<void(uint32_t)>>> benchmarks = {
+        {"acquire", [&](uint32_t idx) {
+            uint32_t imageIndex = 0;
+            layer.acquireNextImageKHR(layer.device, layer.swapchains[idx], UINT64_MAX, VK_NULL_HANDLE, VK_NULL_HANDLE, &imageIndex);
+        }},
+        {"present", [&](uint32_t idx) {
+            const uint32_t imageIndex = 0;
+            VkPresentInfoKHR presentInfo = {};
+            presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            presentInfo.swapchainCount = 1;
+            presentInfo.pSwapchains = &layer.swapchains[idx];
+            presentInfo.pImageIndices = &imageIndex;
+            layer.queuePresentKHR(layer.queues[idx], &presentInfo);
+        }},
+        {"createSampler", [&](uint32_t idx) {
+            (void)idx;
+            VkSampler sampler = VK_NULL_HANDLE;
+            layer.createSampler(layer.device, &samplerInfo, nullptr, &sampler);
+            layer.destroySampler(layer.device, sampler, nullptr);
+        }},
+        {"cmdDraw", [&](uint32_t idx) {
+            layer.cmdDraw(layer.commandBuffers[idx], 3, 1, 0, 0);
+        }},
+        {"getDeviceProcAddr", [&](uint32_t idx) {
+            (void)idx;
+            vkGetDeviceProcAddrFlimes(layer.device, "vkQueuePresentKHR");
+        }},
+    };
+
+    cout << "ns/call (thread CPU time), " << iterations << " iterations per thread" << endl;
+    cout << setw(8) << "threads";
+    for (auto &&benchmark : benchmarks)
+        cout << setw(20) << benchmark.first;
+    cout << endl;
+
+    cout << fixed << setprecision(1);
+    for (uint32_t nThreads = 1; nThreads <= maxThreads; nThreads *= 2)
+    {
+        cout << setw(8) << nThreads;
+        for (auto &&benchmark : benchmarks)
+            cout << setw(20) << measure(nThreads, iterations, benchmark.second) << flush;
+        cout << endl;
+    }
+
+    layer.destroySampler(layer.device, sharedSampler, nullptr);
+    destroyLayer(layer);
+    return 0;
+}
@@ -0,0 +1,442 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "MockDriver.hpp"
+
+#include <string_view>
+#include <cstring>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <map>
+
+using namespace std;
+
+namespace MockDriver {
+
+struct DispatchableObject
+{
+    void *loaderData; // must be the first member
+};
+
+struct Instance : DispatchableObject
+{
+    vector<DispatchableObject> physicalDevices;
+};
+
+struct Device : DispatchableObject
+{
+    vector<DispatchableObject> queues;
+    deque<DispatchableObject> commandBuffers;
+};
+
+static char g_instanceDispatchTable[64];
+
+template<typename T>
+static T newHandle()
+{
+    static atomic<uint64_t> counter = 0;
+    const uint64_t id = ++counter;
+    if constexpr (is_pointer_v<T>)
+        return reinterpret_cast<T>(static_cast<uintptr_t>(id << 4));
+    else
+        return id;
+}
+
+/**/
+
+static VkResult VKAPI_CALL vkCreateInstance(const VkInstanceCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkInstance *pInstance)
+{
+    (void)pCreateInfo;
+    (void)pAllocator;
+
+    auto instance = new Instance;
+    instance->loaderData = g_instanceDispatchTable;
+    instance->physicalDevices.resize(1, {g_instanceDispatchTable});
+    *pInstance = reinterpret_cast<VkInstance>(instance);
+    return VK_SUCCESS;
+}
+static void VKAPI_CALL vkDestroyInstance(VkInstance instance, const VkAllocationCallbacks *pAllocator)
+{
+    (void)pAllocator;
+
+    delete reinterpret_cast<Instance *>(instance);
+}
+static VkResult VKAPI_CALL vkEnumeratePhysicalDevices(VkInstance instance, uint32_t *pPhysicalDeviceCount, VkPhysicalDevice *pPhysicalDevices)
+{
+    auto &physicalDevices = reinterpret_cast<Instance *>(instance)->physicalDevices;
+    if (!pPhysicalDevices)
+    {
+        *pPhysicalDeviceCount = physicalDevices.size();
+        return VK_SUCCESS;
+    }
+    const uint32_t n = min<uint32_t>(*pPhysicalDeviceCount, physicalDevices.size());
+    for (uint32_t i = 0; i < n; ++i)
+        pPhysicalDevices[i] = reinterpret_cast<VkPhysicalDevice>(&physicalDevices[i]);
+    *pPhysicalDeviceCount = n;
+    return (n < physicalDevices.size()) ? VK_INCOMPLETE : VK_SUCCESS;
+}
+static VkResult VKAPI_CALL vkEnumerateDeviceExtensionProperties(VkPhysicalDevice physicalDevice, const char *pLayerName, uint32_t *pPropertyCount, VkExtensionProperties *pProperties)
+{
+    (void)physicalDevice;
+    (void)pLayerName;
+
+    const char *extensions[] = {
+        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+        VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME,
+        VK_KHR_PRESENT_ID_EXTENSION_NAME,
+        VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+    };
+    if (!pProperties)
+    {
+        *pPropertyCount = size(extensions);
+        return VK_SUCCESS;
+    }
+    const uint32_t n = min<uint32_t>(*pPropertyCount, size(extensions));
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        pProperties[i] = {};
+        strncpy(pProperties[i].extensionName, extensions[i], VK_MAX_EXTENSION_NAME_SIZE - 1);
+    }
+    *pPropertyCount = n;
+    return (n < size(extensions)) ? VK_INCOMPLETE : VK_SUCCESS;
+}
+static void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice physicalDevice, VkPhysicalDeviceProperties *pProperties)
+{
+    (void)physicalDevice;
+
+    *pProperties = {};
+    pProperties->limits.maxSamplerLodBias = 15.0f;
+    pProperties->limits.maxSamplerAnisotropy = 16.0f;
+}
+static void VKAPI_CALL vkGetPhysicalDeviceFeatures2(VkPhysicalDevice physicalDevice, VkPhysicalDeviceFeatures2 *pFeatures)
+{
+    (void)physicalDevice;
+
+    pFeatures->features = {};
+    for (auto next = reinterpret_cast<VkBaseOutStructure *>(pFeatures->pNext); next; next = next->pNext)
+    {
+        if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR)
+            reinterpret_cast<VkPhysicalDevicePresentIdFeaturesKHR *>(next)->presentId = VK_TRUE;
+        else if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR)
+            reinterpret_cast<VkPhysicalDevicePresentWaitFeaturesKHR *>(next)->presentWait = VK_TRUE;
+    }
+}
+static VkResult VKAPI_CALL vkGetPhysicalDeviceSurfaceCapabilitiesKHR(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkSurfaceCapabilitiesKHR *pSurfaceCapabilities)
+{
+    (void)physicalDevice;
+    (void)surface;
+
+    *pSurfaceCapabilities = {};
+    pSurfaceCapabilities->minImageCount = 2;
+    pSurfaceCapabilities->maxImageCount = 8;
+    return VK_SUCCESS;
+}
+static VkResult VKAPI_CALL vkGetPhysicalDeviceSurfacePresentModesKHR(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t *pPresentModeCount, VkPresentModeKHR *pPresentModes)
+{
+    (void)physicalDevice;
+    (void)surface;
+
+    constexpr VkPresentModeKHR presentModes[] = {
+        VK_PRESENT_MODE_FIFO_KHR,
+        VK_PRESENT_MODE_IMMEDIATE_KHR,
+        VK_PRESENT_MODE_MAILBOX_KHR,
+    };
+    if (!pPresentModes)
+    {
+        *pPresentModeCount = size(presentModes);
+        return VK_SUCCESS;
+    }
+    const uint32_t n = min<uint32_t>(*pPresentModeCount, size(presentModes));
+    for (uint32_t i = 0; i < n; ++i)
+        pPresentModes[i] = presentModes[i];
+    *pPresentModeCount = n;
+    return (n < size(presentModes)) ? VK_INCOMPLETE : VK_SUCCESS;
+}
+static VkResult VKAPI_CALL vkCreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkDevice *pDevice)
+{
+    (void)physicalDevice;
+    (void)pAllocator;
+
+    auto device = new Device;
+    device->loaderData = new char[64]; // unique dispatch table per device
+
+    uint32_t queueCount = 0;
+    for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; ++i)
+        queueCount += pCreateInfo->pQueueCreateInfos[i].queueCount;
+    device->queues.resize(queueCount, {device->loaderData});
+
+    *pDevice = reinterpret_cast<VkDevice>(device);
+    return VK_SUCCESS;
+}
+
+/**/
+
+static void VKAPI_CALL vkDestroyDevice(VkDevice device, const VkAllocationCallbacks *pAllocator)
+{
+    (void)pAllocator;
+
+    auto deviceObj = reinterpret_cast<Device *>(device);
+    delete[] static_cast<char *>(deviceObj->loaderData);
+    delete deviceObj;
+}
+static VkResult VKAPI_CALL vkCreateSampler(VkDevice device, const VkSamplerCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkSampler *pSampler)
+{
+    (void)device;
+    (void)pCreateInfo;
+    (void)pAllocator;
+
+    *pSampler = newHandle<VkSampler>();
+    return VK_SUCCESS;
+}
+static void VKAPI_CALL vkDestroySampler(VkDevice device, VkSampler sampler, const VkAllocationCallbacks *pAllocator)
+{
+    (void)device;
+    (void)sampler;
+    (void)pAllocator;
+}
+static VkResult VKAPI_CALL vkCreateFence(VkDevice device, const VkFenceCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkFence *pFence)
+{
+    (void)device;
+    (void)pCreateInfo;
+    (void)pAllocator;
+
+    *pFence = newHandle<VkFence>();
+    return VK_SUCCESS;
+}
+static void VKAPI_CALL vkDestroyFence(VkDevice device, VkFence fence, const VkAllocationCallbacks *pAllocator)
+{
+    (void)device;
+    (void)fence;
+    (void)pAllocator;
+}
+static VkResult VKAPI_CALL vkCreateSemaphore(VkDevice device, const VkSemaphoreCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkSemaphore *pSemaphore)
+{
+    (void)device;
+    (void)pCreateInfo;
+    (void)pAllocator;
+
+    *pSemaphore = newHandle<VkSemaphore>();
+    return VK_SUCCESS;
+}
+static void VKAPI_CALL vkDestroySemaphore(VkDevice device, VkSemaphore semaphore, const VkAllocationCallbacks *pAllocator)
+{
+    (void)device;
+    (void)semaphore;
+    (void)pAllocator;
+}
+static VkResult VKAPI_CALL vkWaitForFences(VkDevice device, uint32_t fenceCount, const VkFence *pFences, VkBool32 waitAll, uint64_t timeout)
+{
+    (void)device;
+    (void)fenceCount;
+    (void)pFences;
+    (void)waitAll;
+    (void)timeout;
+
+    return VK_SUCCESS; // GPU work finishes immediately
+}
+static VkResult VKAPI_CALL vkResetFences(VkDevice device, uint32_t fenceCount, const VkFence *pFences)
+{
+    (void)device;
+    (void)fenceCount;
+    (void)pFences;
+
+    return VK_SUCCESS;
+}
+static VkResult VKAPI_CALL vkQueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo *pSubmits, VkFence fence)
+{
+    (void)queue;
+    (void)submitCount;
+    (void)pSubmits;
+    (void)fence;
+
+    return VK_SUCCESS;
+}
+static VkResult VKAPI_CALL vkCreateSwapchainKHR(VkDevice device, const VkSwapchainCreateInfoKHR *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkSwapchainKHR *pSwapchain)
+{
+    (void)device;
+    (void)pCreateInfo;
+    (void)pAllocator;
+
+    *pSwapchain = newHandle<VkSwapchainKHR>();
+    return VK_SUCCESS;
+}
+static void VKAPI_CALL vkDestroySwapchainKHR(VkDevice device, VkSwapchainKHR swapchain, const VkAllocationCallbacks *pAllocator)
+{
+    (void)device;
+    (void)swapchain;
+    (void)pAllocator;
+}
+static VkResult VKAPI_CALL vkGetSwapchainImagesKHR(VkDevice device, VkSwapchainKHR swapchain, uint32_t *pSwapchainImageCount, VkImage *pSwapchainImages)
+{
+    (void)device;
+    (void)swapchain;
+
+    constexpr uint32_t imageCount = 3;
+    if (!pSwapchainImages)
+    {
+        *pSwapchainImageCount = imageCount;
+        return VK_SUCCESS;
+    }
+    const uint32_t n = min(*pSwapchainImageCount, imageCount);
+    for (uint32_t i = 0; i < n; ++i)
+        pSwapchainImages[i] = newHandle<VkImage>();
+    *pSwapchainImageCount = n;
+    return (n < imageCount) ? VK_INCOMPLETE : VK_SUCCESS;
+}
+static VkResult VKAPI_CALL vkGetRefreshCycleDurationGOOGLE(VkDevice device, VkSwapchainKHR swapchain, VkRefreshCycleDurationGOOGLE *pDisplayTimingProperties)
+{
+    (void)device;
+    (void)swapchain;
+
+    pDisplayTimingProperties->refreshDuration = 1000000000ull / 144; // 144 Hz display
+    return VK_SUCCESS;
+}
+static VkResult VKAPI_CALL vkWaitForPresentKHR(VkDevice device, VkSwapchainKHR swapchain, uint64_t presentId, uint64_t timeout)
+{
+    (void)device;
+    (void)swapchain;
+    (void)presentId;
+    (void)timeout;
+
+    return VK_SUCCESS;
+}
+static VkResult VKAPI_CALL vkAcquireNextImageKHR(VkDevice device, VkSwapchainKHR swapchain, uint64_t timeout, VkSemaphore semaphore, VkFence fence, uint32_t *pImageIndex)
+{
+    (void)device;
+    (void)swapchain;
+    (void)timeout;
+    (void)semaphore;
+    (void)fence;
+
+    *pImageIndex = 0;
+    return VK_SUCCESS;
+}
+static VkResult VKAPI_CALL vkAcquireNextImage2KHR(VkDevice device, const VkAcquireNextImageInfoKHR *pAcquireInfo, uint32_t *pImageIndex)
+{
+    (void)device;
+    (void)pAcquireInfo;
+
+    *pImageIndex = 0;
+    return VK_SUCCESS;
+}
+static VkResult VKAPI_CALL vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR *pPresentInfo)
+{
+    (void)queue;
+
+    if (pPresentInfo->pResults)
+    {
+        for (uint32_t i = 0; i < pPresentInfo->swapchainCount; ++i)
+            pPresentInfo->pResults[i] = VK_SUCCESS;
+    }
+    return VK_SUCCESS;
+}
+
+/**/
+
+void getDeviceQueue(VkDevice device, uint32_t queueFamilyIndex, uint32_t queueIndex, VkQueue *pQueue)
+{
+    (void)queueFamilyIndex;
+
+    auto &queues = reinterpret_cast<Device *>(device)->queues;
+    *pQueue = (queueIndex < queues.size())
+        ? reinterpret_cast<VkQueue>(&queues[queueIndex])
+        : VK_NULL_HANDLE
+    ;
+}
+static void VKAPI_CALL vkGetDeviceQueue(VkDevice device, uint32_t queueFamilyIndex, uint32_t queueIndex, VkQueue *pQueue)
+{
+    getDeviceQueue(device, queueFamilyIndex, queueIndex, pQueue);
+}
+
+VkCommandBuffer allocateCommandBuffer(VkDevice device)
+{
+    auto deviceObj = reinterpret_cast<Device *>(device);
+    return reinterpret_cast<VkCommandBuffer>(&deviceObj->commandBuffers.emplace_back(DispatchableObject{deviceObj->loaderData}));
+}
+static void VKAPI_CALL vkCmdDraw(VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance)
+{
+    (void)commandBuffer;
+    (void)vertexCount;
+    (void)instanceCount;
+    (void)firstVertex;
+    (void)firstInstance;
+}
+
+static const map<string_view, PFN_vkVoidFunction> g_instanceFunctions = {
+    {"vkGetInstanceProcAddr", reinterpret_cast<PFN_vkVoidFunction>(getInstanceProcAddr)},
+    {"vkCreateInstance", reinterpret_cast<PFN_vkVoidFunction>(vkCreateInstance)},
+    {"vkDestroyInstance", reinterpret_cast<PFN_vkVoidFunction>(vkDestroyInstance)},
+    {"vkEnumeratePhysicalDevices", reinterpret_cast<PFN_vkVoidFunction>(vkEnumeratePhysicalDevices)},
+    {"vkEnumerateDeviceExtensionProperties", reinterpret_cast<PFN_vkVoidFunction>(vkEnumerateDeviceExtensionProperties)},
+    {"vkGetPhysicalDeviceProperties", reinterpret_cast<PFN_vkVoidFunction>(vkGetPhysicalDeviceProperties)},
+    {"vkGetPhysicalDeviceFeatures2", reinterpret_cast<PFN_vkVoidFunction>(vkGetPhysicalDeviceFeatures2)},
+    {"vkGetPhysicalDeviceSurfaceCapabilitiesKHR", reinterpret_cast<PFN_vkVoidFunction>(vkGetPhysicalDeviceSurfaceCapabilitiesKHR)},
+    {"vkGetPhysicalDeviceSurfacePresentModesKHR", reinterpret_cast<PFN_vkVoidFunction>(vkGetPhysicalDeviceSurfacePresentModesKHR)},
+    {"vkCreateDevice", reinterpret_cast<PFN_vkVoidFunction>(vkCreateDevice)},
+};
+static const map<string_view, PFN_vkVoidFunction> g_deviceFunctions = {
+    {"vkGetDeviceProcAddr", reinterpret_cast<PFN_vkVoidFunction>(getDeviceProcAddr)},
+    {"vkDestroyDevice", reinterpret_cast<PFN_vkVoidFunction>(vkDestroyDevice)},
+    {"vkGetDeviceQueue", reinterpret_cast<PFN_vkVoidFunction>(vkGetDeviceQueue)},
+    {"vkCreateSampler", reinterpret_cast<PFN_vkVoidFunction>(vkCreateSampler)},
+    {"vkDestroySampler", reinterpret_cast<PFN_vkVoidFunction>(vkDestroySampler)},
+    {"vkCreateFence", reinterpret_cast<PFN_vkVoidFunction>(vkCreateFence)},
+    {"vkDestroyFence", reinterpret_cast<PFN_vkVoidFunction>(vkDestroyFence)},
+    {"vkWaitForFences", reinterpret_cast<PFN_vkVoidFunction>(vkWaitForFences)},
+    {"vkResetFences", reinterpret_cast<PFN_vkVoidFunction>(vkResetFences)},
+    {"vkCreateSemaphore", reinterpret_cast<PFN_vkVoidFunction>(vkCreateSemaphore)},
+    {"vkDestroySemaphore", reinterpret_cast<PFN_vkVoidFunction>(vkDestroySemaphore)},
+    {"vkQueueSubmit", reinterpret_cast<PFN_vkVoidFunction>(vkQueueSubmit)},
+    {"vkCmdDraw", reinterpret_cast<PFN_vkVoidFunction>(vkCmdDraw)},
+    {"vkCreateSwapchainKHR", reinterpret_cast<PFN_vkVoidFunction>(vkCreateSwapchainKHR)},
+    {"vkDestroySwapchainKHR", reinterpret_cast<PFN_vkVoidFunction>(vkDestroySwapchainKHR)},
+    {"vkGetSwapchainImagesKHR", reinterpret_cast<PFN_vkVoidFunction>(vkGetSwapchainImagesKHR)},
+    {"vkGetRefreshCycleDurationGOOGLE", reinterpret_cast<PFN_vkVoidFunction>(vkGetRefreshCycleDurationGOOGLE)},
+    {"vkWaitForPresentKHR", reinterpret_cast<PFN_vkVoidFunction>(vkWaitForPresentKHR)},
+    {"vkAcquireNextImageKHR", reinterpret_cast<PFN_vkVoidFunction>(vkAcquireNextImageKHR)},
+    {"vkAcquireNextImage2KHR", reinterpret_cast<PFN_vkVoidFunction>(vkAcquireNextImage2KHR)},
+    {"vkQueuePresentKHR", reinterpret_cast<PFN_vkVoidFunction>(vkQueuePresentKHR)},
+};
+
+PFN_vkVoidFunction VKAPI_CALL getInstanceProcAddr(VkInstance instance, const char *pName)
+{
+    (void)instance;
+
+    if (auto it = g_instanceFunctions.find(pName); it != g_instanceFunctions.end())
+        return it->second;
+    if (auto it = g_deviceFunctions.find(pName); it != g_deviceFunctions.end())
+        return it->second;
+    return nullptr;
+}
+PFN_vkVoidFunction VKAPI_CALL getDeviceProcAddr(VkDevice device, const char *pName)
+{
+    (void)device;
+
+    if (auto it = g_deviceFunctions.find(pName); it != g_deviceFunctions.end())
+        return it->second;
+    return nullptr;
+}
+
+}
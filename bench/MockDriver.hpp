@@ -0,0 +1,45 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <vulkan/vk_layer.h>
+
+/*
+    Fake Vulkan driver placed below the layer, so the layer can be exercised without a GPU.
+
+    All functions succeed immediately, dispatchable handles have a loader dispatch pointer
+    (queues share it with their device) like real driver objects.
+*/
+namespace MockDriver {
+
+PFN_vkVoidFunction VKAPI_CALL getInstanceProcAddr(VkInstance instance, const char *pName);
+PFN_vkVoidFunction VKAPI_CALL getDeviceProcAddr(VkDevice device, const char *pName);
+
+// Not intercepted by the layer, called by the loader trampoline in real world
+void getDeviceQueue(VkDevice device, uint32_t queueFamilyIndex, uint32_t queueIndex, VkQueue *pQueue);
+// Command buffer sharing the device dispatch pointer, released with the device
+VkCommandBuffer allocateCommandBuffer(VkDevice device);
+
+}
@@ -0,0 +1,352 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "../src/FrameLimiter.hpp"
+
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cmath>
+
+#include <time.h>
+
+using namespace std;
+
+/*
+    Measures how accurately FrameLimiter holds the requested framerate.
+
+    A synthetic frame workload is simulated by spinning, the limiter is called after each frame
+    (like in "present" limiter mode). Results are printed as JSON on stdout.
+
+    Frame interval is the time between consecutive "wait()" returns. Jitter and overshoot are
+    calculated only for frames whose work fits into the period - late frames can't be on time.
+*/
+
+using frame_clock = FrameLimiter::frame_clock;
+using duration = FrameLimiter::duration;
+
+struct Workload
+{
+    const char *name;
+    function<double(uint32_t frame, mt19937 &rng)> workFraction; // frame work as a fraction of period
+};
+
+static const Workload g_workloads[] = {
+    {"random", [](uint32_t frame, mt19937 &rng) {
+        (void)frame;
+        return uniform_real_distribution<double>(0.1, 0.9)(rng);
+    }},
+    {"bursty", [](uint32_t frame, mt19937 &rng) {
+        // 8 heavy frames every 60 frames
+        if (frame % 60 < 8)
+            return uniform_real_distribution<double>(0.9, 1.5)(rng);
+        return uniform_real_distribution<double>(0.1, 0.3)(rng);
+    }},
+    {"overrun", [](uint32_t frame, mt19937 &rng) {
+        // Every 10th frame takes 2.5 periods
+        if (frame % 10 == 9)
+            return 2.5;
+        return uniform_real_distribution<double>(0.4, 0.6)(rng);
+    }},
+};
+
+// Jitter histogram bucket upper edges in microseconds, last bucket is unbounded
+constexpr int64_t g_histogramEdgesUs[] = {-1000, -200, -50, -10, 10, 50, 200, 1000, 5000};
+
+struct Result
+{
+    double fps = 0.0;
+    const char *workload = nullptr;
+    uint32_t frames = 0;
+    uint32_t lateFrames = 0;
+    double meanFps = 0.0;
+    double jitterStdDevUs = 0.0;
+    double maxOvershootUs = 0.0;
+    double limiterCpuUsPerFrame = 0.0;
+    uint32_t histogram[size(g_histogramEdgesUs) + 1] = {};
+};
+
+static int64_t threadCpuTimeNs()
+{
+    timespec ts = {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static void spinFor(const duration time)
+{
+    const auto end = frame_clock::now() + time;
+    while (frame_clock::now() < end)
+    {
+    }
+}
+
+static Result run(const double fps, const Workload &workload, const FrameLimiter::Options &options, const double seconds, const uint32_t seed)
+{
+    const auto period = chrono::duration_cast<duration>(chrono::duration<double>(1.0 / fps));
+    const uint32_t nFrames = max<uint32_t>(10, lround(fps * seconds));
+
+    mt19937 rng(seed);
+    FrameLimiter frameLimiter(fps, options);
+
+    Result result;
+    result.fps = fps;
+    result.workload = workload.name;
+    result.frames = nFrames;
+
+    int64_t limiterCpuNs = 0;
+    double jitterSum = 0.0, jitterSqSum = 0.0;
+    uint32_t onTimeFrames = 0;
+
+    frameLimiter.wait();
+    auto firstTime = frame_clock::now();
+    auto lastTime = firstTime;
+
+    for (uint32_t frame = 0; frame < nFrames; ++frame)
+    {
+        const auto workTime = chrono::duration_cast<duration>(period * workload.workFraction(frame, rng));
+        spinFor(workTime);
+
+        const auto cpuStart = threadCpuTimeNs();
+        frameLimiter.wait();
+        limiterCpuNs += threadCpuTimeNs() - cpuStart;
+
+        const auto now = frame_clock::now();
+        const auto interval = now - lastTime;
+        lastTime = now;
+
+        if (workTime >= period)
+        {
+            ++result.lateFrames;
+            continue;
+        }
+
+        const double jitterUs = chrono::duration<double, micro>(interval - period).count();
+        jitterSum += jitterUs;
+        jitterSqSum += jitterUs * jitterUs;
+        result.maxOvershootUs = max(result.maxOvershootUs, jitterUs);
+        ++onTimeFrames;
+
+        size_t bucket = 0;
+        while (bucket < size(g_histogramEdgesUs) && jitterUs >= g_histogramEdgesUs[bucket])
+            ++bucket;
+        ++result.histogram[bucket];
+    }
+
+    result.meanFps = nFrames / chrono::duration<double>(lastTime - firstTime).count();
+    if (onTimeFrames > 0)
+    {
+        const double mean = jitterSum / onTimeFrames;
+        result.jitterStdDevUs = sqrt(max(0.0, jitterSqSum / onTimeFrames - mean * mean));
+    }
+    result.limiterCpuUsPerFrame = limiterCpuNs / 1000.0 / nFrames;
+    return result;
+}
+
+static vector<double> parseRates(const char *str)
+{
+    vector<double> rates;
+    stringstream ss(str);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        const double rate = atof(item.c_str());
+        if (rate > 0.0)
+            rates.push_back(rate);
+    }
+    return rates;
+}
+
+static void printUsage(const char *name)
+{
+    cerr << "Usage: " << name << " [options]" << endl;
+    cerr << "  --rates <fps,...>          framerates to test (default: 30,60,120,144,240,500)" << endl;
+    cerr << "  --seconds <s>              duration of each run (default: 2)" << endl;
+    cerr << "  --workload <name>          random, bursty or overrun (default: all)" << endl;
+    cerr << "  --precise-wait             enable precise wait" << endl;
+    cerr << "  --pacing <mode>            chained or grid (default: chained)" << endl;
+    cerr << "  --catch-up <mode>          skip, frames or reset (default: skip)" << endl;
+    cerr << "  --catch-up-frames <n>      late frames to catch up (default: 2)" << endl;
+    cerr << "  --stress <threads>         CPU stress threads running in background (default: 0)" << endl;
+    cerr << "  --seed <n>                 workload random seed (default: 1)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    vector<double> rates = {30.0, 60.0, 120.0, 144.0, 240.0, 500.0};
+    double seconds = 2.0;
+    const char *workloadName = nullptr;
+    uint32_t stressThreads = 0;
+    uint32_t seed = 1;
+
+    FrameLimiter::Options options = {};
+    options.pacing = FrameLimiter::Pacing::Chained;
+    options.catchUp = FrameLimiter::CatchUp::Skip;
+    options.catchUpFrames = 2;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = (i + 1 < argc);
+        if (strcmp(argv[i], "--rates") == 0 && hasValue)
+        {
+            rates = parseRates(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && hasValue)
+        {
+            seconds = max(0.1, atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--workload") == 0 && hasValue)
+        {
+            workloadName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--precise-wait") == 0)
+        {
+            options.preciseWait = true;
+        }
+        else if (strcmp(argv[i], "--pacing") == 0 && hasValue)
+        {
+            const char *value = argv[++i];
+            if (strcmp(value, "grid") == 0)
+                options.pacing = FrameLimiter::Pacing::Grid;
+            else if (strcmp(value, "chained") == 0)
+                options.pacing = FrameLimiter::Pacing::Chained;
+            else
+                return printUsage(argv[0]), 1;
+        }
+        else if (strcmp(argv[i], "--catch-up") == 0 && hasValue)
+        {
+            const char *value = argv[++i];
+            if (strcmp(value, "skip") == 0)
+                options.catchUp = FrameLimiter::CatchUp::Skip;
+            else if (strcmp(value, "frames") == 0)
+                options.catchUp = FrameLimiter::CatchUp::Frames;
+            else if (strcmp(value, "reset") == 0)
+                options.catchUp = FrameLimiter::CatchUp::Reset;
+            else
+                return printUsage(argv[0]), 1;
+        }
+        else if (strcmp(argv[i], "--catch-up-frames") == 0 && hasValue)
+        {
+            options.catchUpFrames = max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--stress") == 0 && hasValue)
+        {
+            stressThreads = max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+        {
+            seed = strtoul(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    vector<const Workload *> workloads;
+    for (auto &&workload : g_workloads)
+    {
+        if (!workloadName || strcmp(workloadName, workload.name) == 0)
+            workloads.push_back(&workload);
+    }
+    if (rates.empty() || workloads.empty())
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    atomic<bool> stopStress = false;
+    vector<thread> stress;
+    for (uint32_t i = 0; i < stressThreads; ++i)
+    {
+        stress.emplace_back([&] {
+            volatile double x = 1.0;
+            while (!stopStress.load(memory_order_relaxed))
+                x = sqrt(x + 1.0);
+        });
+    }
+
+    vector<Result> results;
+    for (auto rate : rates)
+    {
+        for (auto workload : workloads)
+        {
+            cerr << "Running " << rate << " FPS, " << workload->name << " workload" << endl;
+            results.push_back(run(rate, *workload, options, seconds, seed));
+        }
+    }
+
+    stopStress = true;
+    for (auto &&t : stress)
+        t.join();
+
+    const char *pacingNames[] = {"chained", "grid"};
+    const char *catchUpNames[] = {"skip", "frames", "reset"};
+
+    cout << fixed << setprecision(3);
+    cout << "{" << endl;
+    cout << "  \"options\": {" << endl;
+    cout << "    \"preciseWait\": " << (options.preciseWait ? "true" : "false") << "," << endl;
+    cout << "    \"pacing\": \"" << pacingNames[static_cast<int>(options.pacing)] << "\"," << endl;
+    cout << "    \"catchUp\": \"" << catchUpNames[static_cast<int>(options.catchUp)] << "\"," << endl;
+    cout << "    \"catchUpFrames\": " << options.catchUpFrames << "," << endl;
+    cout << "    \"stressThreads\": " << stressThreads << "," << endl;
+    cout << "    \"seconds\": " << seconds << "," << endl;
+    cout << "    \"seed\": " << seed << endl;
+    cout << "  }," << endl;
+    cout << "  \"histogramEdgesUs\": [";
+    for (size_t i = 0; i < size(g_histogramEdgesUs); ++i)
+        cout << (i > 0 ? ", " : "") << g_histogramEdgesUs[i];
+    cout << "]," << endl;
+    cout << "  \"results\": [" << endl;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const auto &r = results[i];
+        cout << "    {";
+        cout << "\"fps\": " << r.fps;
+        cout << ", \"workload\": \"" << r.workload << "\"";
+        cout << ", \"frames\": " << r.frames;
+        cout << ", \"lateFrames\": " << r.lateFrames;
+        cout << ", \"meanFps\": " << r.meanFps;
+        cout << ", \"jitterStdDevUs\": " << r.jitterStdDevUs;
+        cout << ", \"maxOvershootUs\": " << r.maxOvershootUs;
+        cout << ", \"limiterCpuUsPerFrame\": " << r.limiterCpuUsPerFrame;
+        cout << ", \"jitterHistogram\": [";
+        for (size_t b = 0; b < size(r.histogram); ++b)
+            cout << (b > 0 ? ", " : "") << r.histogram[b];
+        cout << "]}" << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    cout << "  ]" << endl;
+    cout << "}" << endl;
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+# Generates dispatch tables from the function list
+#
+# Usage: cmake -DINPUT=Functions.list -DOUTPUT_DIR=dir -P GenerateDispatch.cmake
+#
+# Outputs:
+#   Dispatch.hpp       - "InstanceDispatch" and "DeviceDispatch" structs with next layer function pointers,
+#                        hooked function names for "ProcTable"
+#   DispatchHooks.inc  - hooked function pointers in the same order as the names, include after the hooks
+
+file(STRINGS "${INPUT}" LINES)
+
+foreach(SCOPE instance device)
+    set(${SCOPE}_MEMBERS "")
+    set(${SCOPE}_INIT "")
+    set(${SCOPE}_NAMES "")
+    set(${SCOPE}_HOOKS "")
+endforeach()
+
+foreach(LINE IN LISTS LINES)
+    string(STRIP "${LINE}" LINE)
+    if(LINE STREQUAL "" OR LINE MATCHES "^#")
+        continue()
+    endif()
+
+    string(REGEX REPLACE "[ \t]+" ";" TOKENS "${LINE}")
+    list(GET TOKENS 0 SCOPE)
+    list(GET TOKENS 1 NAME)
+    list(REMOVE_AT TOKENS 0 1)
+
+    if(NOT SCOPE STREQUAL "instance" AND NOT SCOPE STREQUAL "device")
+        message(FATAL_ERROR "Invalid scope \"${SCOPE}\" in line: ${LINE}")
+    endif()
+
+    set(HOOK "")
+    set(NEXT OFF)
+    set(IFDEF "")
+    foreach(TOKEN IN LISTS TOKENS)
+        if(TOKEN STREQUAL "hook")
+            set(HOOK "${NAME}")
+        elseif(TOKEN MATCHES "^hook=(.+)$")
+            set(HOOK "${CMAKE_MATCH_1}")
+        elseif(TOKEN STREQUAL "next")
+            set(NEXT ON)
+        elseif(TOKEN MATCHES "^ifdef=(.+)$")
+            set(IFDEF "${CMAKE_MATCH_1}")
+        else()
+            message(FATAL_ERROR "Invalid flag \"${TOKEN}\" in line: ${LINE}")
+        endif()
+    endforeach()
+
+    if(IFDEF)
+        set(BEGIN "#ifdef ${IFDEF}\n")
+        set(END "#endif\n")
+    else()
+        set(BEGIN "")
+        set(END "")
+    endif()
+
+    if(NEXT)
+        # "vkCreateSampler" -> "createSampler"
+        string(SUBSTRING "${NAME}" 2 1 FIRST)
+        string(SUBSTRING "${NAME}" 3 -1 REST)
+        string(TOLOWER "${FIRST}" FIRST)
+        set(MEMBER "${FIRST}${REST}")
+
+        if(SCOPE STREQUAL "instance")
+            set(HANDLE "instance")
+        else()
+            set(HANDLE "device")
+        endif()
+
+        string(APPEND ${SCOPE}_MEMBERS "${BEGIN}    PFN_${NAME} ${MEMBER} = nullptr;\n${END}")
+        string(APPEND ${SCOPE}_INIT "${BEGIN}        ${MEMBER} = reinterpret_cast<PFN_${NAME}>(getProcAddr(${HANDLE}, \"${NAME}\"));\n${END}")
+    endif()
+
+    if(HOOK)
+        string(APPEND ${SCOPE}_NAMES "${BEGIN}    \"${NAME}\",\n${END}")
+        string(APPEND ${SCOPE}_HOOKS "${BEGIN}    reinterpret_cast<PFN_vkVoidFunction>(${HOOK}),\n${END}")
+    endif()
+endforeach()
+
+set(HEADER "// Generated by \"cmake/GenerateDispatch.cmake\" from \"src/Functions.list\", do not edit\n")
+
+file(WRITE "${OUTPUT_DIR}/Dispatch.hpp.tmp" "${HEADER}
+#pragma once
+
+#include <vulkan/vk_layer.h>
+
+#include <string_view>
+
+struct InstanceDispatch
+{
+${instance_MEMBERS}
+    void init(PFN_vkGetInstanceProcAddr getProcAddr, VkInstance instance)
+    {
+${instance_INIT}    }
+};
+
+struct DeviceDispatch
+{
+${device_MEMBERS}
+    void init(PFN_vkGetDeviceProcAddr getProcAddr, VkDevice device)
+    {
+${device_INIT}    }
+};
+
+constexpr std::string_view g_instanceHookNames[] = {
+${instance_NAMES}};
+constexpr std::string_view g_deviceHookNames[] = {
+${device_NAMES}};
+")
+
+file(WRITE "${OUTPUT_DIR}/DispatchHooks.inc.tmp" "${HEADER}
+static const PFN_vkVoidFunction g_instanceHooks[] = {
+${instance_HOOKS}};
+static const PFN_vkVoidFunction g_deviceHooks[] = {
+${device_HOOKS}};
+")
+
+# Don't touch the outputs if nothing changed
+foreach(FILE Dispatch.hpp DispatchHooks.inc)
+    configure_file("${OUTPUT_DIR}/${FILE}.tmp" "${OUTPUT_DIR}/${FILE}" COPYONLY)
+    file(REMOVE "${OUTPUT_DIR}/${FILE}.tmp")
+endforeach()
@@ -0,0 +1,137 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "AdaptiveFramerate.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+constexpr double g_minFramerate = 15.0;
+constexpr double g_fractions[] = {4.0 / 5.0, 2.0 / 3.0, 1.0 / 2.0, 1.0 / 3.0, 1.0 / 4.0}; // e.g. 60 -> 48 -> 40 -> 30 -> 20 -> 15
+
+constexpr uint32_t g_windowFrames = 30;
+constexpr double g_percentile = 0.9;
+constexpr double g_downMargin = 1.05; // the lower step must fit the work time with this margin
+constexpr double g_upHeadroom = 0.85; // the work time must fit the higher step with this headroom
+constexpr uint32_t g_minProbeWindows = 3;
+constexpr uint32_t g_maxProbeWindows = 48;
+
+AdaptiveFramerate::AdaptiveFramerate()
+{
+    m_workTimes.reserve(g_windowFrames);
+}
+AdaptiveFramerate::~AdaptiveFramerate()
+{
+}
+
+void AdaptiveFramerate::setMaxFramerate(const double maxFramerate, const double refreshRate)
+{
+    m_steps.clear();
+    m_step = 0;
+    m_workTimes.clear();
+    m_headroomWindows = 0;
+    m_probeWindows = g_minProbeWindows;
+    m_probing = false;
+
+    if (maxFramerate <= 0.0)
+        return;
+
+    m_steps.push_back(maxFramerate);
+    if (refreshRate > 0.0)
+    {
+        for (uint32_t divisor = 1; refreshRate / divisor >= g_minFramerate; ++divisor)
+        {
+            const double step = refreshRate / divisor;
+            if (step < maxFramerate)
+                m_steps.push_back(step);
+        }
+    }
+    else
+    {
+        for (auto fraction : g_fractions)
+        {
+            const double step = maxFramerate * fraction;
+            if (step >= g_minFramerate)
+                m_steps.push_back(step);
+        }
+    }
+}
+
+bool AdaptiveFramerate::addFrame(const duration workTime)
+{
+    if (m_steps.size() < 2)
+        return false;
+
+    m_workTimes.push_back(workTime);
+    if (m_workTimes.size() < g_windowFrames)
+        return false;
+
+    const auto percentileIt = m_workTimes.begin() + static_cast<size_t>(m_workTimes.size() * g_percentile);
+    nth_element(m_workTimes.begin(), percentileIt, m_workTimes.end());
+    const double workTimeS = chrono::duration<double>(*percentileIt).count();
+    m_workTimes.clear();
+
+    const auto period = [this](const size_t step) {
+        return 1.0 / m_steps[step];
+    };
+
+    const size_t prevStep = m_step;
+
+    if (workTimeS > period(m_step))
+    {
+        // Can't hold the current step, go to the highest one which fits
+        while (m_step + 1 < m_steps.size() && workTimeS * g_downMargin > period(m_step))
+            ++m_step;
+
+        if (m_probing)
+            m_probeWindows = min(m_probeWindows * 2, g_maxProbeWindows);
+        m_probing = false;
+        m_headroomWindows = 0;
+    }
+    else
+    {
+        if (m_probing)
+        {
+            m_probing = false;
+            m_probeWindows = g_minProbeWindows;
+        }
+
+        if (m_step > 0 && workTimeS <= period(m_step - 1) * g_upHeadroom)
+        {
+            if (++m_headroomWindows >= m_probeWindows)
+            {
+                --m_step;
+                m_probing = true;
+                m_headroomWindows = 0;
+            }
+        }
+        else
+        {
+            m_headroomWindows = 0;
+        }
+    }
+
+    return (m_step != prevStep);
+}
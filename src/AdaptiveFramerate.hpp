@@ -0,0 +1,65 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include "FrameLimiter.hpp"
+
+#include <vector>
+
+// Lowers the framerate to the highest step the application can sustain, probes upward when headroom returns
+class AdaptiveFramerate
+{
+public:
+    using duration = FrameLimiter::duration;
+
+public:
+    AdaptiveFramerate();
+    ~AdaptiveFramerate();
+
+    // Steps are the refresh rate divisors if the refresh rate is known, fractions of the framerate otherwise
+    void setMaxFramerate(const double maxFramerate, const double refreshRate);
+    inline double maxFramerate() const
+    {
+        return m_steps.empty() ? 0.0 : m_steps.front();
+    }
+
+    // "workTime" is the frame time without the frame limiter sleep, returns "true" if the framerate has changed
+    bool addFrame(const duration workTime);
+
+    inline double framerate() const
+    {
+        return m_steps.empty() ? 0.0 : m_steps[m_step];
+    }
+
+private:
+    std::vector<double> m_steps; // descending
+    size_t m_step = 0;
+
+    std::vector<duration> m_workTimes; // current window
+
+    uint32_t m_headroomWindows = 0;
+    uint32_t m_probeWindows = 0; // windows with headroom required to probe upward, grows after failed probes
+    bool m_probing = false;
+};
@@ -0,0 +1,136 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "CoordinatorClient.hpp"
+#include "CoordinatorProtocol.hpp"
+#include "ExternalControl.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+CoordinatorClient::CoordinatorClient(const double weight)
+    : m_weight(weight)
+{
+}
+CoordinatorClient::~CoordinatorClient()
+{
+    disconnect();
+}
+
+optional<double> CoordinatorClient::update(const Report &report)
+{
+    if (m_fd < 0 && !connect())
+        return nullopt;
+
+    if (!send("REPORT " + to_string(report.fps) + " " + to_string(report.frameCostUs)))
+    {
+        disconnect();
+        return nullopt;
+    }
+
+    optional<double> cap;
+
+    char buffer[CoordinatorProtocol::MaxMessageSize + 1];
+    for (;;)
+    {
+        const auto n = recv(m_fd, buffer, CoordinatorProtocol::MaxMessageSize, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+        {
+            // Keep the last cap until the coordinator is back
+            disconnect();
+            break;
+        }
+
+        buffer[n] = '\0';
+
+        double fps = 0.0;
+        if (sscanf(buffer, "CAP %lf", &fps) == 1 && fps > 0.0)
+            cap = fps;
+    }
+
+    return cap;
+}
+
+bool CoordinatorClient::connect()
+{
+    const auto socketPath = ExternalControl::getPath().parent_path().append(CoordinatorProtocol::SocketName);
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.native().size() >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, socketPath.c_str());
+
+    m_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (m_fd < 0)
+        return false;
+
+    if (::connect(m_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        disconnect();
+        return false;
+    }
+
+    string name = ExternalControl::getPath().filename();
+    for (auto &&c : name)
+    {
+        if (isspace(static_cast<unsigned char>(c)))
+            c = '_';
+    }
+
+    if (!send("HELLO " + to_string(getpid()) + " " + to_string(m_weight) + " " + name))
+    {
+        disconnect();
+        return false;
+    }
+
+    cerr << VK_LAYER_FLIMES_NAME << " connected to coordinator: " << socketPath << endl;
+    return true;
+}
+void CoordinatorClient::disconnect()
+{
+    if (m_fd > -1)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool CoordinatorClient::send(const string &message)
+{
+    return ::send(m_fd, message.data(), message.size(), MSG_NOSIGNAL | MSG_DONTWAIT) == static_cast<ssize_t>(message.size());
+}
@@ -0,0 +1,119 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "DrawCounters.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <map>
+
+#include <pthread.h>
+
+using namespace std;
+
+static vector<unique_ptr<DrawCounters::Thread>> g_threads;
+static map<string, DrawCounters::Counts, less<>> g_exitedThreads; // counts of exited threads by name
+static mutex g_threadsMutex;
+
+DrawCounters::Counts &DrawCounters::Counts::operator+=(const Counts &other)
+{
+    draws += other.draws;
+    vertices += other.vertices;
+    dispatches += other.dispatches;
+    return *this;
+}
+DrawCounters::Counts DrawCounters::Counts::operator-(const Counts &other) const
+{
+    Counts counts;
+    counts.draws = draws - other.draws;
+    counts.vertices = vertices - other.vertices;
+    counts.dispatches = dispatches - other.dispatches;
+    return counts;
+}
+
+DrawCounters::Counts DrawCounters::Thread::load() const
+{
+    Counts counts;
+    counts.draws = draws.load(memory_order_relaxed);
+    counts.vertices = vertices.load(memory_order_relaxed);
+    counts.dispatches = dispatches.load(memory_order_relaxed);
+    return counts;
+}
+
+DrawCounters::Counts DrawCounters::collect(const string_view threadName)
+{
+    // Thread names are truncated to 15 characters
+    const auto name = threadName.substr(0, sizeof(Thread::name) - 1);
+
+    Counts counts;
+
+    scoped_lock locker(g_threadsMutex);
+    for (auto &&thread : g_threads)
+    {
+        if (name.empty() || name == thread->name)
+            counts += thread->load();
+    }
+    for (auto &&[exitedName, exitedCounts] : g_exitedThreads)
+    {
+        if (name.empty() || name == exitedName)
+            counts += exitedCounts;
+    }
+
+    return counts;
+}
+
+DrawCounters::Thread *DrawCounters::registerThread()
+{
+    // Moves the counts to "g_exitedThreads" when the thread exits
+    struct ThreadExit
+    {
+        Thread *thread = nullptr;
+
+        ~ThreadExit()
+        {
+            scoped_lock locker(g_threadsMutex);
+            g_exitedThreads[thread->name] += thread->load();
+            for (auto it = g_threads.begin(); it != g_threads.end(); ++it)
+            {
+                if (it->get() == thread)
+                {
+                    g_threads.erase(it);
+                    break;
+                }
+            }
+            t_thread = nullptr;
+        }
+    };
+
+    auto thread = make_unique<Thread>();
+    pthread_getname_np(pthread_self(), thread->name, sizeof(thread->name));
+
+    thread_local ThreadExit threadExit;
+    threadExit.thread = thread.get();
+
+    scoped_lock locker(g_threadsMutex);
+    return g_threads.emplace_back(move(thread)).get();
+}
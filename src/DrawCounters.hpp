@@ -0,0 +1,91 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <string_view>
+#include <atomic>
+
+// Per-thread command recording counters, written without synchronization by the recording thread and summed on demand
+class DrawCounters
+{
+public:
+    struct Counts
+    {
+        uint64_t draws = 0; // direct and indirect draw commands
+        uint64_t vertices = 0; // vertices or indices of direct draw commands
+        uint64_t dispatches = 0; // direct and indirect dispatch commands
+
+        Counts &operator+=(const Counts &other);
+        Counts operator-(const Counts &other) const;
+    };
+
+    struct alignas(64) Thread
+    {
+        std::atomic<uint64_t> draws {0};
+        std::atomic<uint64_t> vertices {0};
+        std::atomic<uint64_t> dispatches {0};
+        char name[16] = {};
+
+        Counts load() const;
+    };
+
+public:
+    static inline void addDraw(const uint32_t vertices)
+    {
+        auto thread = local();
+        increment(thread->draws, 1);
+        increment(thread->vertices, vertices);
+    }
+    static inline void addIndirectDraw()
+    {
+        increment(local()->draws, 1);
+    }
+    static inline void addDispatch()
+    {
+        increment(local()->dispatches, 1);
+    }
+
+    // Cumulative counts of all threads or threads with the given name only
+    static Counts collect(const std::string_view threadName = {});
+
+private:
+    static Thread *registerThread();
+
+    static inline Thread *local()
+    {
+        if (!t_thread)
+            t_thread = registerThread();
+        return t_thread;
+    }
+
+    // Each counter has a single writer, so atomic read-modify-write is not needed
+    static inline void increment(std::atomic<uint64_t> &counter, const uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+private:
+    static inline thread_local Thread *t_thread = nullptr;
+};
@@ -23,32 +23,68 @@
 */
 
 #include "ExternalControl.hpp"
+#include "ExecutableName.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <cstring>
+#include <cctype>
+#include <cerrno>
 
 #include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <sys/poll.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <fcntl.h>
 
 using namespace std;
 
+constexpr size_t g_maxSocketClients = 64;
+constexpr size_t g_bufferSize = 4096;
+
+// Splits upper-cased commands, "token" keeps the incomplete command, values after "=" keep the case
+template<typename Fn>
+static void splitCommands(const char *data, size_t size, string &token, Fn &&fn)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        const char c = data[i];
+        if (!isspace(static_cast<unsigned char>(c)) && c != ';')
+        {
+            token += (token.find('=') == string::npos) ? toupper(c) : c;
+            continue;
+        }
+        if (!token.empty())
+        {
+            fn(token);
+            token.clear();
+        }
+    }
+}
+
+filesystem::path ExternalControl::getPath()
+{
+    return filesystem::temp_directory_path().append(VK_LAYER_FLIMES_NAME).append(getExecutableName()).concat("-").concat(to_string(getpid()));
+}
+
 ExternalControl::ExternalControl(const Fn &fn)
     : m_processExternalCommandFn(fn)
 {
-    m_path = filesystem::temp_directory_path().append(VK_LAYER_FLIMES_NAME);
+    m_efd = eventfd(0, 0);
+    if (m_efd < 0)
+    {
+        return;
+    }
 
-    auto fileName = strrchr(program_invocation_name, '\\');
-    if (!fileName)
-        fileName = strrchr(program_invocation_name, '/');
-    if (!fileName)
-        fileName = program_invocation_name;
-    else
-        ++fileName;
+    if (!m_processExternalCommandFn)
+    {
+        return;
+    }
 
-    m_fifoPath = filesystem::path(m_path).append(fileName).concat("-").concat(to_string(getpid()));
+    const auto fifoPath = getPath();
+    m_path = fifoPath.parent_path();
 
     error_code e;
     filesystem::create_directories(m_path, e);
@@ -58,22 +94,17 @@ ExternalControl::ExternalControl(const Fn &fn)
         return;
     }
 
-    m_efd = eventfd(0, 0);
-    if (m_efd < 0)
-    {
-        return;
-    }
-
-    mkfifo(m_fifoPath.c_str(), 0600);
-    if (!filesystem::is_fifo(m_fifoPath))
+    mkfifo(fifoPath.c_str(), 0600);
+    if (!filesystem::is_fifo(fifoPath))
     {
-        cerr << "  Can't create external control pipe: " << m_fifoPath << "\n";
+        cerr << "  Can't create external control pipe: " << fifoPath << "\n";
         return;
     }
+    m_fifoPath = fifoPath;
 
     cerr << "  External control enabled: " << m_fifoPath << "\n";
 
-    m_thr = thread(bind(&ExternalControl::run, this));
+    openSocket();
 }
 ExternalControl::~ExternalControl()
 {
@@ -82,8 +113,12 @@ ExternalControl::~ExternalControl()
         eventfd_write(m_efd, 1); // abort "pool()"
 
         m_thr.join();
-
+    }
+    if (!m_fifoPath.empty())
+    {
         filesystem::remove(m_fifoPath);
+        if (m_socketFd > -1)
+            filesystem::remove(m_socketPath);
 
         try
         {
@@ -92,20 +127,76 @@ ExternalControl::~ExternalControl()
         catch (const filesystem::filesystem_error &)
         {}
     }
+    if (m_socketFd > -1)
+    {
+        close(m_socketFd);
+    }
     if (m_efd > -1)
     {
         close(m_efd);
     }
 }
 
+void ExternalControl::addTimer(const chrono::milliseconds interval, const TimerFn &fn)
+{
+    m_timers.push_back({interval, fn, chrono::steady_clock::now() + interval});
+}
+
+void ExternalControl::addFd(const int fd, const FdFn &fn)
+{
+    m_fds.emplace_back(fd, fn);
+}
+
+void ExternalControl::start()
+{
+    if (m_efd < 0 || (m_fifoPath.empty() && m_timers.empty() && m_fds.empty()))
+        return;
+
+    m_thr = thread(bind(&ExternalControl::run, this));
+}
+
+void ExternalControl::openSocket()
+{
+    m_socketPath = m_fifoPath;
+    m_socketPath.concat(".sock");
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (m_socketPath.native().size() >= sizeof(addr.sun_path))
+    {
+        cerr << "  External control socket path is too long: " << m_socketPath << "\n";
+        return;
+    }
+    strcpy(addr.sun_path, m_socketPath.c_str());
+
+    m_socketFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_socketFd < 0)
+        return;
+
+    unlink(m_socketPath.c_str());
+    if (bind(m_socketFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || chmod(m_socketPath.c_str(), 0600) != 0 || listen(m_socketFd, 16) != 0)
+    {
+        cerr << "  Can't create external control socket: " << m_socketPath << "\n";
+        unlink(m_socketPath.c_str());
+        close(m_socketFd);
+        m_socketFd = -1;
+        return;
+    }
+
+    cerr << "  External control socket: " << m_socketPath << "\n";
+}
+
 void ExternalControl::run()
 {
     int fd = -1;
     string str;
+    vector<int> clients;
+    vector<pollfd> fds;
+    char buffer[g_bufferSize];
 
     for (;;)
     {
-        if (fd < 0)
+        if (fd < 0 && !m_fifoPath.empty())
         {
             fd = open(m_fifoPath.c_str(), O_RDONLY | O_NONBLOCK);
             if (fd < 0)
@@ -115,20 +206,21 @@ void ExternalControl::run()
             }
         }
 
-        pollfd fds[2] = {
-            {
-                .fd = m_efd,
-                .events = POLLIN,
-                .revents = 0,
-            },
-            {
-                .fd = fd,
-                .events = POLLIN,
-                .revents = 0,
-            },
-        };
-        if (poll(fds, 2, -1) < 0)
-            return;
+        fds.clear();
+        fds.push_back({.fd = m_efd, .events = POLLIN, .revents = 0});
+        fds.push_back({.fd = fd, .events = POLLIN, .revents = 0}); // ignored if "-1"
+        fds.push_back({.fd = m_socketFd, .events = POLLIN, .revents = 0});
+        for (auto &&[extraFd, fn] : m_fds)
+            fds.push_back({.fd = extraFd, .events = POLLIN, .revents = 0});
+        for (auto client : clients)
+            fds.push_back({.fd = client, .events = POLLIN, .revents = 0});
+
+        if (poll(fds.data(), fds.size(), runTimers()) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
 
         // Check for app exit
         if (fds[0].revents & POLLIN)
@@ -138,20 +230,15 @@ void ExternalControl::run()
             break;
         }
 
-        // Check for external commands
+        // Check for external commands, each one is processed separately
         if (fds[1].revents & POLLIN)
         {
-            char c;
-            while (read(fd, &c, 1) == 1)
+            ssize_t n;
+            while ((n = read(fd, buffer, sizeof(buffer))) > 0)
             {
-                if (c != '\n' && c != ' ')
-                {
-                    str += toupper(c);
-                    continue;
-                }
-
-                m_processExternalCommandFn(str);
-                str.clear();
+                splitCommands(buffer, n, str, [this](const string &command) {
+                    m_processExternalCommandFn({command});
+                });
             }
         }
         if (fds[1].revents & (POLLERR | POLLHUP | POLLNVAL))
@@ -159,10 +246,96 @@ void ExternalControl::run()
             close(fd);
             fd = -1;
         }
+
+        // Check for additional file descriptors
+        for (size_t i = 0; i < m_fds.size(); ++i)
+        {
+            if (fds[3 + i].revents & POLLIN)
+                m_fds[i].second();
+        }
+
+        // Check for socket clients, all commands from one message are processed together
+        for (size_t i = 3 + m_fds.size(); i < fds.size(); ++i)
+        {
+            if (fds[i].revents == 0)
+                continue;
+
+            // "MSG_TRUNC" returns the full message size, longer messages are discarded
+            const auto n = (fds[i].revents & POLLIN) ? recv(fds[i].fd, buffer, sizeof(buffer), MSG_TRUNC) : 0;
+            if (n > static_cast<ssize_t>(sizeof(buffer)))
+            {
+                constexpr char reply[] = "ERROR\n";
+                if (send(fds[i].fd, reply, strlen(reply), MSG_NOSIGNAL | MSG_DONTWAIT) >= 0)
+                    continue;
+            }
+            else if (n > 0)
+            {
+                vector<string> commands;
+                string token;
+                splitCommands(buffer, n, token, [&](const string &command) {
+                    commands.push_back(command);
+                });
+                if (!token.empty())
+                    commands.push_back(move(token));
+
+                const auto reply = m_processExternalCommandFn(commands);
+                if (send(fds[i].fd, reply.data(), reply.size(), MSG_NOSIGNAL | MSG_DONTWAIT) >= 0)
+                    continue;
+            }
+            else if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            {
+                continue;
+            }
+
+            close(fds[i].fd);
+            clients.erase(find(clients.begin(), clients.end(), fds[i].fd));
+        }
+
+        // Accept new clients after handling the current ones, so "fds" indexes match "clients"
+        if (fds[2].revents & POLLIN)
+        {
+            int client;
+            while ((client = accept4(m_socketFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) > -1)
+            {
+                if (clients.size() < g_maxSocketClients)
+                    clients.push_back(client);
+                else
+                    close(client);
+            }
+        }
     }
 
+    for (auto client : clients)
+    {
+        close(client);
+    }
     if (fd > -1)
     {
         close(fd);
     }
 }
+
+// Runs expired timers, returns "poll()" timeout to the next timer
+int ExternalControl::runTimers()
+{
+    if (m_timers.empty())
+        return -1;
+
+    auto now = chrono::steady_clock::now();
+    auto next = chrono::steady_clock::time_point::max();
+    for (size_t i = 0; i < m_timers.size(); ++i) // "fn()" can add timers
+    {
+        auto &timer = m_timers[i];
+        if (timer.next <= now)
+        {
+            timer.fn();
+            now = chrono::steady_clock::now();
+            timer.next += timer.interval;
+            if (timer.next <= now)
+                timer.next = now + timer.interval;
+        }
+        next = min(next, timer.next);
+    }
+
+    return chrono::duration_cast<chrono::milliseconds>(next - now + chrono::microseconds(999)).count();
+}
@@ -26,26 +26,60 @@
 
 #include <filesystem>
 #include <functional>
+#include <chrono>
 #include <thread>
+#include <string>
+#include <vector>
+#include <deque>
 
 class ExternalControl
 {
-    using Fn = std::function<void(const std::string &str)>;
+    // Receives upper-cased commands, returns the reply (socket only)
+    using Fn = std::function<std::string(const std::vector<std::string> &commands)>;
+    using TimerFn = std::function<void()>;
+    using FdFn = std::function<void()>;
 
 public:
+    // "/tmp/vk-layer-flimes/name-pid", used as a base for all per-process files
+    static std::filesystem::path getPath();
+
+public:
+    // Without "fn" only timers are handled, FIFO and socket aren't created
     ExternalControl(const Fn &fn);
     ~ExternalControl();
 
+    // Timers and file descriptors are handled on the external control thread, must be added before "start()",
+    // timers can also be added from the external control thread
+    void addTimer(const std::chrono::milliseconds interval, const TimerFn &fn);
+    void addFd(const int fd, const FdFn &fn); // "fn" is called when "fd" is readable
+
+    void start();
+
 private:
     void run();
 
+    int runTimers();
+
+    void openSocket();
+
 private:
     const Fn m_processExternalCommandFn;
 
     std::filesystem::path m_path;
     std::filesystem::path m_fifoPath;
+    std::filesystem::path m_socketPath;
+
+    struct Timer
+    {
+        std::chrono::milliseconds interval;
+        TimerFn fn;
+        std::chrono::steady_clock::time_point next;
+    };
+    std::deque<Timer> m_timers; // references stay valid when timers are added from a timer
+    std::vector<std::pair<int, FdFn>> m_fds;
 
     std::thread m_thr;
 
     int m_efd = -1;
+    int m_socketFd = -1;
 };
@@ -24,34 +24,217 @@
 
 #include "FrameLimiter.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <utility>
 #include <thread>
+#include <cerrno>
+
+#include <sys/prctl.h>
+#include <time.h>
 
 using namespace std;
 
-FrameLimiter::FrameLimiter(const double fps)
+constexpr auto g_initialWakeMargin = chrono::microseconds(200);
+constexpr auto g_maxWakeMargin = chrono::milliseconds(2);
+
+static inline void cpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    this_thread::yield();
+#endif
+}
+
+// Best rational approximation of "value" (continued fractions)
+static pair<uint64_t, uint64_t> toRational(const double value)
+{
+    constexpr uint64_t maxDen = 100000;
+
+    uint64_t num0 = 0, den0 = 1;
+    uint64_t num1 = 1, den1 = 0;
+    double x = value;
+    for (;;)
+    {
+        const auto a = static_cast<uint64_t>(x);
+        const uint64_t num2 = a * num1 + num0;
+        const uint64_t den2 = a * den1 + den0;
+        if (den2 > maxDen)
+            break;
+
+        num0 = num1; den0 = den1;
+        num1 = num2; den1 = den2;
+
+        const double frac = x - a;
+        if (frac < 1e-9 || abs(static_cast<double>(num1) / den1 - value) <= value * 1e-12)
+            break;
+        x = 1.0 / frac;
+    }
+    return {num1, den1};
+}
+
+FrameLimiter::FrameLimiter(const double fps, const Options &options)
+    : m_options(options)
+    , m_wakeMargin(g_initialWakeMargin)
 {
-    m_delay = (fps > 0.0)
-        ? duration(static_cast<duration::rep>(duration::period::den / fps / duration::period::num))
-        : duration::zero();
     m_timePoint = frame_clock::now().time_since_epoch();
+
+    setPeriod(fps);
+
+    if (m_options.pacing == Pacing::Grid && m_delay != duration::zero())
+        advanceDeadline();
 }
 FrameLimiter::~FrameLimiter()
 {
 }
 
-void FrameLimiter::wait()
+void FrameLimiter::setFramerate(const double fps)
+{
+    // "m_timePoint" is the last wake-up in chained pacing, so only grid deadline must be moved
+    const bool grid = (m_options.pacing == Pacing::Grid);
+    if (grid && m_delay != duration::zero())
+        m_timePoint -= m_delay;
+
+    setPeriod(fps);
+
+    if (grid && m_delay != duration::zero())
+        advanceDeadline();
+}
+
+void FrameLimiter::wait(const duration lead)
 {
     if (m_delay == duration::zero())
         return;
 
-    const duration newTimePoint = frame_clock::now().time_since_epoch();
+    if (m_options.pacing == Pacing::Grid)
+        waitGrid(lead);
+    else
+        waitChained(lead);
+}
+
+void FrameLimiter::setPeriod(const double fps)
+{
+    m_delay = (fps > 0.0)
+        ? duration(static_cast<duration::rep>(duration::period::den / fps / duration::period::num))
+        : duration::zero();
+    m_periodRem = 0;
+    m_periodDen = 1;
+    m_periodAcc = 0;
+
+    if (m_options.pacing == Pacing::Grid && fps > 0.0)
+    {
+        // period = ticksPerSecond * fpsDen / fpsNum
+        const auto [fpsNum, fpsDen] = toRational(fps);
+        if (fpsNum > 0)
+        {
+            const uint64_t ticks = static_cast<uint64_t>(duration::period::den / duration::period::num) * fpsDen;
+            m_delay = duration(static_cast<duration::rep>(ticks / fpsNum));
+            m_periodRem = ticks % fpsNum;
+            m_periodDen = fpsNum;
+        }
+    }
+}
+
+void FrameLimiter::waitChained(const duration lead)
+{
+    const duration now = frame_clock::now().time_since_epoch();
+    const duration newTimePoint = now + lead;
     const duration sleepTime = m_delay - newTimePoint + m_timePoint;
 
     m_timePoint = newTimePoint;
 
     if (sleepTime.count() > 0)
     {
-        this_thread::sleep_for(sleepTime);
+        if (m_options.preciseWait)
+            preciseSleepUntil(now + sleepTime);
+        else
+            this_thread::sleep_for(sleepTime);
         m_timePoint += sleepTime;
     }
 }
+void FrameLimiter::waitGrid(const duration lead)
+{
+    // "m_timePoint" is the next deadline on the grid, "now" is the expected frame end
+
+    const duration now = frame_clock::now().time_since_epoch() + lead;
+    if (now > m_timePoint)
+    {
+        if (m_options.catchUp == CatchUp::Reset || now - m_timePoint > chrono::seconds(1))
+        {
+            m_timePoint = now;
+            m_periodAcc = 0;
+        }
+        else if (m_options.catchUp == CatchUp::Skip)
+        {
+            while (m_timePoint < now)
+                advanceDeadline();
+        }
+        else
+        {
+            const auto maxLate = m_delay * m_options.catchUpFrames;
+            while (now - m_timePoint > maxLate)
+                advanceDeadline();
+        }
+    }
+
+    if (m_timePoint > now)
+        sleepUntil(m_timePoint - lead);
+
+    advanceDeadline();
+}
+
+void FrameLimiter::advanceDeadline()
+{
+    m_timePoint += m_delay;
+    m_periodAcc += m_periodRem;
+    if (m_periodAcc >= m_periodDen)
+    {
+        m_periodAcc -= m_periodDen;
+        m_timePoint += duration(1);
+    }
+}
+
+void FrameLimiter::sleepUntil(const duration timePoint)
+{
+    if (m_options.preciseWait)
+        preciseSleepUntil(timePoint);
+    else
+        this_thread::sleep_until(frame_clock::time_point(timePoint));
+}
+void FrameLimiter::preciseSleepUntil(const duration timePoint)
+{
+    // "steady_clock" is "CLOCK_MONOTONIC" on Linux, so time points can be passed directly
+
+    const int timerSlack = prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+    if (timerSlack > 1)
+        prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0);
+
+    const duration sleepUntil = timePoint - m_wakeMargin;
+    if (sleepUntil > frame_clock::now().time_since_epoch())
+    {
+        const auto secs = chrono::duration_cast<chrono::seconds>(sleepUntil);
+        const timespec ts = {
+            .tv_sec = static_cast<time_t>(secs.count()),
+            .tv_nsec = static_cast<long>(chrono::duration_cast<chrono::nanoseconds>(sleepUntil - secs).count()),
+        };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+        {}
+
+        // Fast attack, slow decay - the margin follows the worst recent oversleep
+        const duration oversleep = frame_clock::now().time_since_epoch() - sleepUntil;
+        if (oversleep > m_wakeMargin)
+            m_wakeMargin += (oversleep - m_wakeMargin) / 2;
+        else
+            m_wakeMargin -= (m_wakeMargin - oversleep) / 32;
+        m_wakeMargin = clamp<duration>(m_wakeMargin, duration::zero(), g_maxWakeMargin);
+    }
+
+    while (frame_clock::now().time_since_epoch() < timePoint)
+        cpuRelax();
+
+    if (timerSlack > 1)
+        prctl(PR_SET_TIMERSLACK, timerSlack, 0, 0, 0);
+}
@@ -24,6 +24,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <chrono>
 
 class FrameLimiter
@@ -32,13 +33,71 @@ public:
     using frame_clock = std::chrono::steady_clock;
     using duration = frame_clock::duration;
 
+    enum class Pacing
+    {
+        Chained, // each deadline is relative to the previous wake-up
+        Grid, // absolute deadlines with an exact rational period
+    };
+    enum class CatchUp
+    {
+        Skip, // wait for the next grid slot
+        Frames, // don't wait until at most "catchUpFrames" late frames are caught up
+        Reset, // restart the grid from the late frame
+    };
+
+    struct Options
+    {
+        bool preciseWait;
+        Pacing pacing;
+        CatchUp catchUp;
+        uint32_t catchUpFrames;
+
+        inline bool operator ==(const Options &other) const
+        {
+            return (preciseWait == other.preciseWait && pacing == other.pacing && catchUp == other.catchUp && catchUpFrames == other.catchUpFrames);
+        }
+        inline bool operator !=(const Options &other) const
+        {
+            return !(*this == other);
+        }
+    };
+
 public:
-    FrameLimiter(const double fps);
+    FrameLimiter(const double fps, const Options &options);
     ~FrameLimiter();
 
-    void wait();
+    // Changes the framerate keeping the pacing phase, the new period starts from the last deadline
+    void setFramerate(const double fps);
+
+    inline const Options &options() const
+    {
+        return m_options;
+    }
+
+    // "lead" - wake up earlier, so the frame which takes "lead" to finish ends at the deadline
+    void wait(const duration lead = duration::zero());
 
 private:
+    void setPeriod(const double fps);
+
+    void waitChained(const duration lead);
+    void waitGrid(const duration lead);
+
+    void advanceDeadline();
+
+    void sleepUntil(const duration timePoint);
+    void preciseSleepUntil(const duration timePoint);
+
+private:
+    const Options m_options;
+
     duration m_delay;
     duration m_timePoint;
+
+    // Grid period is "m_delay + m_periodRem / m_periodDen"
+    uint64_t m_periodRem = 0;
+    uint64_t m_periodDen = 1;
+    uint64_t m_periodAcc = 0;
+
+    duration m_wakeMargin;
 };
@@ -0,0 +1,280 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "FrameLog.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+using namespace std;
+
+constexpr size_t g_blockSize = 4096; // "O_DIRECT" alignment
+constexpr size_t g_bufferSize = 64 * 1024;
+constexpr auto g_drainInterval = chrono::milliseconds(100);
+constexpr auto g_flushInterval = chrono::seconds(1);
+constexpr int g_rotatedFiles = 3; // "path.1" is the newest
+
+FrameLog::FrameLog(const Settings &settings)
+    : m_settings(settings)
+    , m_csv(settings.path.extension() == ".csv")
+    , m_direct(settings.direct)
+{
+    if (m_settings.path.has_parent_path())
+    {
+        error_code e;
+        filesystem::create_directories(m_settings.path.parent_path(), e);
+    }
+
+    m_buffer = static_cast<char *>(aligned_alloc(g_blockSize, g_bufferSize));
+    if (!m_buffer || !openFile())
+        return;
+
+    cerr << "  Frame log enabled: " << m_settings.path << (m_direct ? " (O_DIRECT)" : "") << "\n";
+
+    m_thr = thread(&FrameLog::run, this);
+}
+FrameLog::~FrameLog()
+{
+    if (m_thr.joinable())
+    {
+        {
+            lock_guard locker(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_one();
+        m_thr.join();
+    }
+
+    closeFile();
+    free(m_buffer);
+
+    for (auto &&source : m_sources)
+        m_dropped += source->m_dropped.load(memory_order_relaxed);
+    if (m_dropped > 0)
+        cerr << VK_LAYER_FLIMES_NAME << " frame log: " << m_dropped << " records dropped" << endl;
+}
+
+shared_ptr<FrameLog::Source> FrameLog::addSource()
+{
+    auto source = make_shared<Source>();
+
+    lock_guard locker(m_mutex);
+    m_sources.push_back(source);
+
+    return source;
+}
+
+void FrameLog::run()
+{
+    vector<shared_ptr<Source>> sources, releasedSources;
+    auto nextFlush = chrono::steady_clock::now() + g_flushInterval;
+
+    for (bool stop = false; !stop && isOpen();)
+    {
+        {
+            unique_lock locker(m_mutex);
+            stop = m_cond.wait_for(locker, g_drainInterval, [this] {
+                return m_stop;
+            });
+
+            // Sources owned only by the log were released with their swapchains, drain them for the last time
+            for (auto it = m_sources.begin(); it != m_sources.end();)
+            {
+                if (it->use_count() == 1)
+                {
+                    releasedSources.push_back(move(*it));
+                    it = m_sources.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            sources = m_sources;
+        }
+        atomic_thread_fence(memory_order_acquire);
+
+        for (auto &&source : sources)
+            drain(source.get());
+        for (auto &&source : releasedSources)
+        {
+            drain(source.get());
+            m_dropped += source->m_dropped.load(memory_order_relaxed);
+        }
+        sources.clear();
+        releasedSources.clear();
+
+        if (const auto now = chrono::steady_clock::now(); now >= nextFlush)
+        {
+            flush(false);
+            nextFlush = now + g_flushInterval;
+        }
+    }
+}
+
+void FrameLog::drain(Source *source)
+{
+    FrameLogFormat::Record record;
+    while (isOpen() && source->m_ring.pop(record))
+    {
+        if (m_csv)
+        {
+            char line[128];
+            const int size = FrameLogFormat::formatCsv(record, line, sizeof(line));
+            if (size > 0)
+                append(line, min<size_t>(size, sizeof(line) - 1));
+        }
+        else
+        {
+            append(&record, sizeof(record));
+        }
+    }
+}
+
+void FrameLog::append(const void *data, size_t size)
+{
+    if (m_fileSize + m_bufferUsed + size > m_settings.maxFileSize && m_fileSize + m_bufferUsed > m_headerSize)
+    {
+        rotate();
+        if (!isOpen())
+            return;
+    }
+    if (m_bufferUsed + size > g_bufferSize && !flush(false))
+        return;
+
+    memcpy(m_buffer + m_bufferUsed, data, size);
+    m_bufferUsed += size;
+}
+
+// Writes the buffer, "O_DIRECT" writes only whole blocks unless "all" is set
+bool FrameLog::flush(bool all)
+{
+    if (!isOpen())
+        return false;
+
+    const size_t size = (m_direct && !all) ? (m_bufferUsed & ~(g_blockSize - 1)) : m_bufferUsed;
+    size_t written = 0;
+    while (written < size)
+    {
+        size_t toWrite = size - written;
+        if (m_direct)
+        {
+            toWrite &= ~(g_blockSize - 1);
+            if (toWrite == 0)
+            {
+                // The unaligned tail is written when closing the file
+                fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+                m_direct = false;
+                toWrite = size - written;
+            }
+        }
+
+        const auto n = write(m_fd, m_buffer + written, toWrite);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            cerr << VK_LAYER_FLIMES_NAME << " frame log write error: " << strerror(errno) << endl;
+            m_bufferUsed = 0;
+            closeFile();
+            return false;
+        }
+        written += n;
+    }
+
+    m_fileSize += written;
+    m_bufferUsed -= written;
+    memmove(m_buffer, m_buffer + written, m_bufferUsed);
+
+    return true;
+}
+
+bool FrameLog::openFile()
+{
+    m_direct = m_settings.direct;
+    m_fd = open(m_settings.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (m_direct ? O_DIRECT : 0), 0644);
+    if (m_fd < 0 && m_direct && errno == EINVAL)
+    {
+        cerr << "  Frame log: O_DIRECT is not supported, using buffered writes\n";
+        m_direct = false;
+        m_fd = open(m_settings.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (m_fd < 0)
+    {
+        cerr << "  Can't create frame log file: " << m_settings.path << "\n";
+        return false;
+    }
+
+    m_fileSize = 0;
+    m_bufferUsed = 0;
+
+    if (m_csv)
+    {
+        m_headerSize = strlen(FrameLogFormat::CsvHeader);
+        memcpy(m_buffer, FrameLogFormat::CsvHeader, m_headerSize);
+    }
+    else
+    {
+        FrameLogFormat::Header header = {};
+        header.magic = FrameLogFormat::Header::Magic;
+        header.version = FrameLogFormat::Header::Version;
+        header.recordSize = sizeof(FrameLogFormat::Record);
+        header.pid = getpid();
+
+        m_headerSize = sizeof(header);
+        memcpy(m_buffer, &header, m_headerSize);
+    }
+    m_bufferUsed = m_headerSize;
+
+    return true;
+}
+void FrameLog::closeFile()
+{
+    if (!isOpen())
+        return;
+
+    flush(true);
+
+    if (m_fd > -1)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+void FrameLog::rotate()
+{
+    closeFile();
+
+    const auto &path = m_settings.path;
+    error_code e;
+    for (int i = g_rotatedFiles - 1; i > 0; --i)
+        filesystem::rename(filesystem::path(path).concat("." + to_string(i)), filesystem::path(path).concat("." + to_string(i + 1)), e);
+    filesystem::rename(path, filesystem::path(path).concat(".1"), e);
+
+    openFile();
+}
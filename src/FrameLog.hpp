@@ -0,0 +1,109 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include "FrameLogFormat.hpp"
+#include "SpscRing.hpp"
+
+#include <condition_variable>
+#include <filesystem>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <mutex>
+
+// Asynchronous frame log, records are written to a file by a background thread
+class FrameLog
+{
+public:
+    struct Settings
+    {
+        std::filesystem::path path;
+        uint64_t maxFileSize = 64ull << 20; // rotate when exceeded
+        bool direct = false; // "O_DIRECT" writes
+    };
+
+    // Per-swapchain source, acquire and present are externally synchronized, so there is one producer at a time
+    class Source
+    {
+        friend class FrameLog;
+
+    public:
+        // Never blocks, the record is dropped if the ring is full
+        inline void push(const FrameLogFormat::Record &record)
+        {
+            if (!m_ring.push(record))
+                m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+    private:
+        SpscRing<FrameLogFormat::Record, 1024> m_ring;
+        std::atomic<uint64_t> m_dropped {0};
+    };
+
+public:
+    FrameLog(const Settings &settings);
+    ~FrameLog();
+
+    inline bool isOpen() const
+    {
+        return (m_fd > -1);
+    }
+
+    std::shared_ptr<Source> addSource();
+
+private:
+    void run();
+
+    void drain(Source *source);
+
+    void append(const void *data, size_t size);
+    bool flush(bool all);
+
+    bool openFile();
+    void closeFile();
+    void rotate();
+
+private:
+    const Settings m_settings;
+    const bool m_csv;
+    bool m_direct; // cleared for the unaligned tail of the file
+
+    int m_fd = -1;
+    uint64_t m_fileSize = 0;
+    size_t m_headerSize = 0;
+
+    char *m_buffer = nullptr;
+    size_t m_bufferUsed = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stop = false;
+    std::vector<std::shared_ptr<Source>> m_sources;
+    uint64_t m_dropped = 0; // records dropped by released sources
+
+    std::thread m_thr;
+};
@@ -0,0 +1,86 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+
+/*
+    Frame log written by "VK_LAYER_FLIMES_FRAME_LOG".
+
+    Binary file: "Header" followed by "Record"s in native byte order, every rotated file starts with its own header.
+    CSV file (".csv" extension): "CsvHeader" line followed by records formatted by "formatCsv()".
+    "flimes-log2csv" converts binary files to CSV.
+*/
+namespace FrameLogFormat {
+
+enum class Event : uint8_t
+{
+    Acquire, // image acquired, after the frame limiter sleep in "acquire" limiter mode
+    Present, // frame presented, before the frame limiter sleep in other limiter modes
+};
+
+struct Header
+{
+    static constexpr uint32_t Magic = 0x4c464c46; // "FLFL"
+    static constexpr uint32_t Version = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t pid;
+    uint64_t reserved[2];
+};
+static_assert(sizeof(Header) == 32);
+
+struct Record
+{
+    uint64_t timestampNs; // CLOCK_MONOTONIC
+    uint64_t swapchain; // VkSwapchainKHR handle value
+    uint32_t frameTimeNs; // time since the previous present, "0" for acquire
+    uint32_t sleepTimeNs; // frame limiter sleep in this acquire, or since the previous present
+    int32_t presentMode; // VkPresentModeKHR
+    Event event;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(Record) == 32);
+
+constexpr auto CsvHeader = "timestamp_ns,event,swapchain,frame_time_ns,sleep_time_ns,present_mode\n";
+
+// Returns the number of characters written, like "snprintf()"
+inline int formatCsv(const Record &record, char *buffer, size_t size)
+{
+    return snprintf(buffer, size, "%" PRIu64 ",%s,0x%" PRIx64 ",%" PRIu32 ",%" PRIu32 ",%" PRId32 "\n",
+        record.timestampNs,
+        record.event == Event::Acquire ? "acquire" : "present",
+        record.swapchain,
+        record.frameTimeNs,
+        record.sleepTimeNs,
+        record.presentMode
+    );
+}
+
+}
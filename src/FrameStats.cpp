@@ -0,0 +1,170 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "FrameStats.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <numeric>
+#include <vector>
+
+using namespace std;
+
+FrameStats::FrameStats()
+{
+}
+FrameStats::~FrameStats()
+{
+}
+
+void FrameStats::addSleep(const duration sleepTime)
+{
+    m_pendingSleep.fetch_add(sleepTime.count(), memory_order_relaxed);
+}
+FrameStats::Frame FrameStats::addFrame(const time_point timePoint)
+{
+    Frame frame = {
+        .frameTime = duration::zero(),
+        .sleepTime = duration(m_pendingSleep.exchange(0, memory_order_relaxed)),
+    };
+
+    if (m_lastFrame.time_since_epoch().count() > 0)
+    {
+        frame.frameTime = timePoint - m_lastFrame;
+
+        const uint64_t idx = m_count.load(memory_order_relaxed);
+
+        // Orders the announcement before the sample stores for the readers
+        m_writeCount.store(idx + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+
+        auto &sample = m_samples[idx & (Size - 1)];
+        sample.frameTime.store(frame.frameTime.count(), memory_order_relaxed);
+        sample.sleepTime.store(frame.sleepTime.count(), memory_order_relaxed);
+        m_totalFrameTime.store(m_totalFrameTime.load(memory_order_relaxed) + frame.frameTime.count(), memory_order_relaxed);
+        m_totalSleepTime.store(m_totalSleepTime.load(memory_order_relaxed) + frame.sleepTime.count(), memory_order_relaxed);
+        m_count.store(idx + 1, memory_order_release);
+    }
+
+    m_lastFrame = timePoint;
+
+    return frame;
+}
+
+FrameStats::Summary FrameStats::summary() const
+{
+    Summary summary;
+
+    const uint64_t count = m_count.load(memory_order_acquire);
+    const uint64_t n = min<uint64_t>(count, Size);
+
+    vector<int64_t> frameTimes;
+    frameTimes.reserve(n);
+    int64_t sleepSum = 0;
+    for (uint64_t i = count - n; i < count; ++i)
+    {
+        auto &sample = m_samples[i & (Size - 1)];
+        frameTimes.push_back(sample.frameTime.load(memory_order_relaxed));
+        sleepSum += sample.sleepTime.load(memory_order_relaxed);
+    }
+
+    // Drop the samples which might have been overwritten while copying
+    atomic_thread_fence(memory_order_acquire);
+    const uint64_t overwritten = min<uint64_t>(m_writeCount.load(memory_order_relaxed) - count, n);
+    frameTimes.erase(frameTimes.begin(), frameTimes.begin() + overwritten);
+
+    if (frameTimes.empty())
+        return summary;
+
+    constexpr double toMs = 1e3 * duration::period::num / duration::period::den;
+
+    summary.frames = frameTimes.size();
+
+    const double sum = accumulate(frameTimes.begin(), frameTimes.end(), 0.0);
+    const double mean = sum / frameTimes.size();
+    if (sum > 0.0)
+        summary.avgFps = 1e3 / (mean * toMs);
+
+    double sqDiffSum = 0.0;
+    for (auto &&frameTime : frameTimes)
+        sqDiffSum += (frameTime - mean) * (frameTime - mean);
+    summary.variance = sqDiffSum / frameTimes.size() * toMs * toMs;
+
+    summary.avgSleep = static_cast<double>(sleepSum) / frameTimes.size() * toMs;
+
+    sort(frameTimes.begin(), frameTimes.end());
+
+    const auto percentile = [&](const double p) {
+        const size_t idx = min<size_t>(frameTimes.size() * p / 100.0, frameTimes.size() - 1);
+        return frameTimes[idx] * toMs;
+    };
+    summary.p50 = percentile(50.0);
+    summary.p95 = percentile(95.0);
+    summary.p99 = percentile(99.0);
+
+    // Average framerate of the slowest frames
+    const auto lowFps = [&](const double p) {
+        const size_t cnt = max<size_t>(frameTimes.size() * p / 100.0, 1);
+        const double worstSum = accumulate(frameTimes.end() - cnt, frameTimes.end(), 0.0);
+        return (worstSum > 0.0) ? 1e3 / (worstSum / cnt * toMs) : 0.0;
+    };
+    summary.low1Fps = lowFps(1.0);
+    summary.low01Fps = lowFps(0.1);
+
+    return summary;
+}
+FrameStats::Totals FrameStats::totals() const
+{
+    // Sequence lock on the sample counters, retried if a frame was added while reading
+    Totals totals;
+    do
+    {
+        totals.frames = m_count.load(memory_order_acquire);
+        totals.frameTime = duration(m_totalFrameTime.load(memory_order_relaxed));
+        totals.sleepTime = duration(m_totalSleepTime.load(memory_order_relaxed));
+        atomic_thread_fence(memory_order_acquire);
+    } while (m_writeCount.load(memory_order_relaxed) != totals.frames);
+    return totals;
+}
+
+ostream &operator<<(ostream &os, const FrameStats::Summary &summary)
+{
+    const auto flags = os.flags();
+    const auto precision = os.precision();
+    os << fixed << setprecision(2)
+       << "frames: " << summary.frames
+       << ", avg fps: " << summary.avgFps
+       << ", 1% low: " << summary.low1Fps
+       << ", 0.1% low: " << summary.low01Fps
+       << ", p50: " << summary.p50 << " ms"
+       << ", p95: " << summary.p95 << " ms"
+       << ", p99: " << summary.p99 << " ms"
+       << ", variance: " << summary.variance << " ms^2"
+       << ", avg sleep: " << summary.avgSleep << " ms"
+    ;
+    os.flags(flags);
+    os.precision(precision);
+    return os;
+}
@@ -0,0 +1,101 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include "FrameLimiter.hpp"
+
+#include <iosfwd>
+#include <atomic>
+#include <array>
+
+// Lock-free frame time statistics, written by a single presenting thread, readable from any thread
+class FrameStats
+{
+public:
+    using duration = FrameLimiter::duration;
+    using time_point = FrameLimiter::frame_clock::time_point;
+
+    static constexpr uint32_t Size = 1024; // must be a power of two
+
+    struct Frame
+    {
+        duration frameTime;
+        duration sleepTime;
+    };
+
+    struct Summary
+    {
+        uint32_t frames = 0;
+
+        double avgFps = 0.0;
+        double low1Fps = 0.0;
+        double low01Fps = 0.0;
+
+        // Frame time in milliseconds
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double variance = 0.0;
+
+        // Average time spent in the frame limiter per frame in milliseconds
+        double avgSleep = 0.0;
+    };
+
+    // Cumulative since creation, difference of two values gives statistics for a time interval
+    struct Totals
+    {
+        uint64_t frames = 0;
+        duration frameTime = duration::zero();
+        duration sleepTime = duration::zero();
+    };
+
+public:
+    FrameStats();
+    ~FrameStats();
+
+    void addSleep(const duration sleepTime);
+    Frame addFrame(const time_point timePoint);
+
+    Summary summary() const;
+    Totals totals() const;
+
+private:
+    struct Sample
+    {
+        std::atomic<int64_t> frameTime {0};
+        std::atomic<int64_t> sleepTime {0};
+    };
+
+    std::array<Sample, Size> m_samples;
+    std::atomic<uint64_t> m_count {0}; // published samples
+    std::atomic<uint64_t> m_writeCount {0}; // samples being written, announced before the sample is overwritten
+    std::atomic<int64_t> m_totalFrameTime {0};
+    std::atomic<int64_t> m_totalSleepTime {0};
+
+    std::atomic<int64_t> m_pendingSleep {0};
+    time_point m_lastFrame;
+};
+
+std::ostream &operator<<(std::ostream &os, const FrameStats::Summary &summary);
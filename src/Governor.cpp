@@ -0,0 +1,161 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "Governor.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <cstdlib>
+
+using namespace std;
+
+static optional<string> readLine(const filesystem::path &path)
+{
+    ifstream file(path);
+    string line;
+    if (!getline(file, line))
+        return nullopt;
+    return line;
+}
+
+bool Governor::parseCurve(string_view str, vector<Step> &curve)
+{
+    const auto parseNumber = [](string_view s, double &value) {
+        while (!s.empty() && s.front() == ' ')
+            s.remove_prefix(1);
+        while (!s.empty() && s.back() == ' ')
+            s.remove_suffix(1);
+        // "from_chars()" for floating point is not available in all standard libraries
+        const string tmp(s);
+        char *end = nullptr;
+        value = strtod(tmp.c_str(), &end);
+        return (!tmp.empty() && *end == '\0');
+    };
+
+    vector<Step> steps;
+    while (!str.empty())
+    {
+        const auto pos = str.find(',');
+        const auto item = str.substr(0, pos);
+        str = (pos == string_view::npos) ? string_view() : str.substr(pos + 1);
+
+        const auto colon = item.find(':');
+        if (colon == string_view::npos)
+            return false;
+
+        Step step;
+        if (!parseNumber(item.substr(0, colon), step.temperature) || !parseNumber(item.substr(colon + 1), step.framerate) || step.framerate <= 0.0)
+            return false;
+        steps.push_back(step);
+    }
+    if (steps.empty())
+        return false;
+
+    sort(steps.begin(), steps.end(), [](const Step &a, const Step &b) {
+        return (a.temperature < b.temperature);
+    });
+    curve = move(steps);
+    return true;
+}
+
+Governor::Governor(const Settings &settings)
+    : m_settings(settings)
+{
+}
+Governor::~Governor()
+{
+}
+
+Governor::State Governor::update()
+{
+    State state;
+    state.temperature = readTemperature();
+    state.onBattery = isOnBattery();
+
+    const auto &curve = m_settings.curve;
+    if (state.temperature)
+    {
+        const double temperature = *state.temperature;
+        while (m_step < curve.size() && temperature >= curve[m_step].temperature)
+            ++m_step;
+        while (m_step > 0 && temperature < curve[m_step - 1].temperature - m_settings.hysteresis)
+            --m_step;
+    }
+
+    const auto applyCap = [&](const double framerate) {
+        if (framerate > 0.0 && (state.framerate <= 0.0 || framerate < state.framerate))
+            state.framerate = framerate;
+    };
+    if (m_step > 0)
+        applyCap(curve[m_step - 1].framerate);
+    if (state.onBattery)
+        applyCap(m_settings.batteryFramerate);
+
+    return state;
+}
+
+// The highest temperature of all (or matching) thermal zones
+optional<double> Governor::readTemperature() const
+{
+    if (m_settings.curve.empty())
+        return nullopt;
+
+    optional<double> temperature;
+
+    error_code e;
+    for (auto &&entry : filesystem::directory_iterator(m_settings.sysfsRoot / "class/thermal", e))
+    {
+        if (entry.path().filename().native().rfind("thermal_zone", 0) != 0)
+            continue;
+
+        if (!m_settings.thermalZoneType.empty() && readLine(entry.path() / "type") != m_settings.thermalZoneType)
+            continue;
+
+        // Millidegrees Celsius
+        const auto line = readLine(entry.path() / "temp");
+        int64_t milliCelsius = 0;
+        if (!line || from_chars(line->data(), line->data() + line->size(), milliCelsius).ec != errc())
+            continue;
+
+        temperature = max(temperature.value_or(milliCelsius / 1000.0), milliCelsius / 1000.0);
+    }
+
+    return temperature;
+}
+
+bool Governor::isOnBattery() const
+{
+    if (m_settings.batteryFramerate <= 0.0)
+        return false;
+
+    error_code e;
+    for (auto &&entry : filesystem::directory_iterator(m_settings.sysfsRoot / "class/power_supply", e))
+    {
+        if (readLine(entry.path() / "type") == "Battery" && readLine(entry.path() / "status") == "Discharging")
+            return true;
+    }
+
+    return false;
+}
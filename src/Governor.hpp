@@ -0,0 +1,78 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <string_view>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Framerate cap from the temperature and the power source, sampled from sysfs
+class Governor
+{
+public:
+    // The cap is used from the temperature in Celsius degrees
+    struct Step
+    {
+        double temperature = 0.0;
+        double framerate = 0.0;
+    };
+
+    struct Settings
+    {
+        std::filesystem::path sysfsRoot = "/sys";
+        std::string thermalZoneType; // use thermal zones of this type only, all zones if empty
+        std::vector<Step> curve; // ascending temperatures
+        double hysteresis = 3.0; // lower the temperature step after the temperature drops by this value below it
+        double batteryFramerate = 0.0; // cap when running on battery
+    };
+
+    struct State
+    {
+        std::optional<double> temperature;
+        bool onBattery = false;
+        double framerate = 0.0; // 0 - no cap
+    };
+
+public:
+    // Parses comma-separated "temperature:framerate" steps, e.g. "75:60,85:45,95:30"
+    static bool parseCurve(std::string_view str, std::vector<Step> &curve);
+
+public:
+    Governor(const Settings &settings);
+    ~Governor();
+
+    State update();
+
+private:
+    std::optional<double> readTemperature() const;
+    bool isOnBattery() const;
+
+private:
+    const Settings m_settings;
+
+    size_t m_step = 0; // number of curve steps in effect
+};
@@ -0,0 +1,172 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <type_traits>
+#include <cstdint>
+#include <atomic>
+#include <array>
+
+// Dispatchable handles created from the same device (device, queues, command buffers) share the key
+struct DispatchKey
+{
+    template<typename Handle>
+    static inline uint64_t get(Handle handle)
+    {
+        return reinterpret_cast<uintptr_t>(*reinterpret_cast<void **>(handle));
+    }
+};
+
+// Non-dispatchable handles are pointers on 64-bit and "uint64_t" on 32-bit
+struct HandleKey
+{
+    template<typename Handle>
+    static inline uint64_t get(Handle handle)
+    {
+        if constexpr (std::is_pointer_v<Handle>)
+            return reinterpret_cast<uintptr_t>(handle);
+        else
+            return handle;
+    }
+};
+
+/*
+    Open-addressed map from a Vulkan handle to layer data.
+
+    "find()" is wait-free and does only plain atomic loads, so it can be used on hot paths without locking.
+    "insert()" and "erase()" must be serialized by the caller, erased slots are reused by "insert()" and become
+    empty again once no probe sequence goes through them. The caller owns the values - an erased value
+    must stay alive until no reader can use it, Vulkan guarantees that for objects being destroyed.
+*/
+template<typename T, typename Key, uint32_t Size = 64>
+class HandleMap
+{
+    static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+    template<typename Handle>
+    inline T *find(Handle handle) const
+    {
+        if (!handle)
+            return nullptr;
+
+        const uint64_t key = Key::get(handle);
+        for (uint32_t i = 0, idx = hash(key); i < Size; ++i, idx = (idx + 1) & (Size - 1))
+        {
+            auto &slot = m_slots[idx];
+            const uint64_t slotKey = slot.key.load(std::memory_order_acquire);
+            if (slotKey == key)
+                return slot.value.load(std::memory_order_relaxed);
+            if (slotKey == s_empty)
+                break;
+        }
+        return nullptr;
+    }
+
+    template<typename Handle>
+    bool insert(Handle handle, T *value)
+    {
+        const uint64_t key = Key::get(handle);
+        Slot *freeSlot = nullptr;
+        for (uint32_t i = 0, idx = hash(key); i < Size; ++i, idx = (idx + 1) & (Size - 1))
+        {
+            auto &slot = m_slots[idx];
+            const uint64_t slotKey = slot.key.load(std::memory_order_relaxed);
+            if (slotKey == key)
+            {
+                slot.value.store(value, std::memory_order_release);
+                return true;
+            }
+            if (slotKey == s_tombstone && !freeSlot)
+                freeSlot = &slot;
+            if (slotKey == s_empty)
+            {
+                if (!freeSlot)
+                    freeSlot = &slot;
+                break;
+            }
+        }
+        if (!freeSlot)
+            return false;
+
+        freeSlot->value.store(value, std::memory_order_relaxed);
+        freeSlot->key.store(key, std::memory_order_release);
+        return true;
+    }
+
+    template<typename Handle>
+    void erase(Handle handle)
+    {
+        const uint64_t key = Key::get(handle);
+        for (uint32_t i = 0, idx = hash(key); i < Size; ++i, idx = (idx + 1) & (Size - 1))
+        {
+            auto &slot = m_slots[idx];
+            const uint64_t slotKey = slot.key.load(std::memory_order_relaxed);
+            if (slotKey == key)
+            {
+                const uint32_t nextIdx = (idx + 1) & (Size - 1);
+                if (m_slots[nextIdx].key.load(std::memory_order_relaxed) != s_empty)
+                {
+                    slot.key.store(s_tombstone, std::memory_order_release);
+                    break;
+                }
+
+                // Nothing is probed past an empty slot, so the tombstones ending here can be emptied, too
+                for (uint32_t j = 0; j < Size; ++j, idx = (idx - 1) & (Size - 1))
+                {
+                    auto &prevSlot = m_slots[idx];
+                    if (j > 0 && prevSlot.key.load(std::memory_order_relaxed) != s_tombstone)
+                        break;
+                    prevSlot.value.store(nullptr, std::memory_order_relaxed);
+                    prevSlot.key.store(s_empty, std::memory_order_release);
+                }
+                break;
+            }
+            if (slotKey == s_empty)
+                break;
+        }
+    }
+
+private:
+    static inline uint32_t hash(const uint64_t key)
+    {
+        // Fibonacci hashing
+        return static_cast<uint32_t>((key * 0x9e3779b97f4a7c15ull) >> 32) & (Size - 1);
+    }
+
+private:
+    static constexpr uint64_t s_empty = 0;
+    static constexpr uint64_t s_tombstone = ~uint64_t();
+
+    struct Slot
+    {
+        std::atomic<uint64_t> key {s_empty};
+        std::atomic<T *> value {nullptr};
+    };
+    std::array<Slot, Size> m_slots;
+};
+
+template<typename T>
+using DispatchMap = HandleMap<T, DispatchKey>;
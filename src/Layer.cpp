@@ -23,14 +23,40 @@
 */
 
 #include "ExternalControl.hpp"
+#include "ExecutableName.hpp"
+#include "ProfileDatabase.hpp"
+#include "LoadDetector.hpp"
+#include "DrawCounters.hpp"
+#include "Governor.hpp"
+#include "AdaptiveFramerate.hpp"
+#include "CoordinatorClient.hpp"
+#include "ProcTable.hpp"
+#include "Dispatch.hpp"
+#include "HandleMap.hpp"
 #include "FrameLimiter.hpp"
+#include "FrameStats.hpp"
+#include "Telemetry.hpp"
+#include "FrameLog.hpp"
+#include "Tracer.hpp"
+#include "SamplerCache.hpp"
+#include "SamplerRules.hpp"
+#include "Rcu.hpp"
 
 #include <vulkan/vk_layer.h>
 
 #include <shared_mutex>
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <fstream>
 #include <optional>
+#include <sstream>
+#include <limits>
+#include <atomic>
 #include <cctype>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
 #include <memory>
 #include <string>
 #include <vector>
@@ -38,12 +64,6 @@
 #include <map>
 #include <set>
 
-#ifdef SW
-#   include <pthread.h>
-#   include <unordered_map>
-#   include <cstring>
-#endif
-
 #ifndef VK_LAYER_EXPORT
 #   define VK_LAYER_EXPORT __attribute__((visibility("default")))
 #endif
@@ -52,52 +72,148 @@ using namespace std;
 
 constexpr auto g_enableExternalControlKey = "VK_LAYER_FLIMES_ENABLE_EXTERNAL_CONTROL";
 constexpr auto g_externalControlVerboseKey = "VK_LAYER_FLIMES_EXTERNAL_CONTROL_VERBOSE";
+constexpr auto g_statsEnvKey = "VK_LAYER_FLIMES_STATS";
+constexpr auto g_telemetryEnvKey = "VK_LAYER_FLIMES_TELEMETRY";
+constexpr auto g_frameLogEnvKey = "VK_LAYER_FLIMES_FRAME_LOG";
+constexpr auto g_frameLogMaxSizeEnvKey = "VK_LAYER_FLIMES_FRAME_LOG_MAX_SIZE";
+constexpr auto g_frameLogDirectEnvKey = "VK_LAYER_FLIMES_FRAME_LOG_DIRECT";
+constexpr auto g_traceEnvKey = "VK_LAYER_FLIMES_TRACE";
+constexpr auto g_coordinatorEnvKey = "VK_LAYER_FLIMES_COORDINATOR";
+constexpr auto g_profilesEnvKey = "VK_LAYER_FLIMES_PROFILES";
+constexpr auto g_governorEnvKey = "VK_LAYER_FLIMES_GOVERNOR";
+constexpr auto g_governorBatteryEnvKey = "VK_LAYER_FLIMES_GOVERNOR_BATTERY";
+constexpr auto g_governorHysteresisEnvKey = "VK_LAYER_FLIMES_GOVERNOR_HYSTERESIS";
+constexpr auto g_governorThermalZoneEnvKey = "VK_LAYER_FLIMES_GOVERNOR_THERMAL_ZONE";
+constexpr auto g_governorSysfsEnvKey = "VK_LAYER_FLIMES_GOVERNOR_SYSFS";
+constexpr auto g_drawCountersEnvKey = "VK_LAYER_FLIMES_DRAW_COUNTERS";
+constexpr auto g_samplerCacheEnvKey = "VK_LAYER_FLIMES_SAMPLER_CACHE";
+constexpr auto g_loadDetectorEnvKey = "VK_LAYER_FLIMES_LOAD_DETECTOR";
+constexpr auto g_loadDetectorThreadEnvKey = "VK_LAYER_FLIMES_LOAD_DETECTOR_THREAD";
+constexpr auto g_loadDetectorDelayEnvKey = "VK_LAYER_FLIMES_LOAD_DETECTOR_DELAY";
 
 constexpr auto g_framerateEnvKey = "VK_LAYER_FLIMES_FRAMERATE";
+constexpr auto g_autoFramerateOffsetEnvKey = "VK_LAYER_FLIMES_AUTO_FRAMERATE_OFFSET";
+constexpr auto g_autoFramerateDivisorEnvKey = "VK_LAYER_FLIMES_AUTO_FRAMERATE_DIVISOR";
+constexpr auto g_refreshRateEnvKey = "VK_LAYER_FLIMES_REFRESH_RATE";
+constexpr auto g_adaptiveEnvKey = "VK_LAYER_FLIMES_ADAPTIVE";
+constexpr auto g_preciseWaitEnvKey = "VK_LAYER_FLIMES_PRECISE_WAIT";
+constexpr auto g_pacingEnvKey = "VK_LAYER_FLIMES_PACING";
+constexpr auto g_catchUpEnvKey = "VK_LAYER_FLIMES_CATCH_UP";
+constexpr auto g_limiterModeEnvKey = "VK_LAYER_FLIMES_LIMITER_MODE";
+constexpr auto g_presentWaitEnvKey = "VK_LAYER_FLIMES_PRESENT_WAIT";
+constexpr auto g_maxFramesInFlightEnvKey = "VK_LAYER_FLIMES_MAX_FRAMES_IN_FLIGHT";
 constexpr auto g_filterEnvKey = "VK_LAYER_FLIMES_FILTER";
 constexpr auto g_mipLodBiasEnvKey = "VK_LAYER_FLIMES_MIP_LOD_BIAS";
 constexpr auto g_anisotropyEnvKey = "VK_LAYER_FLIMES_MAX_ANISOTROPY";
+constexpr auto g_samplerRulesEnvKey = "VK_LAYER_FLIMES_SAMPLER_RULES";
+constexpr auto g_samplerRulesFileEnvKey = "VK_LAYER_FLIMES_SAMPLER_RULES_FILE";
 constexpr auto g_minImageCountEnvKey = "VK_LAYER_FLIMES_MIN_IMAGE_COUNT";
 constexpr auto g_presentModeEnvKey = "VK_LAYER_FLIMES_PRESENT_MODE";
 constexpr auto g_preferMailboxPresentModeEnvKey = "VK_LAYER_FLIMES_PREFER_MAILBOX_PRESENT_MODE";
 
+// Settings parsed into "Config", they can be changed at runtime
+constexpr const char *g_configEnvKeys[] = {
+    g_framerateEnvKey,
+    g_autoFramerateOffsetEnvKey,
+    g_autoFramerateDivisorEnvKey,
+    g_refreshRateEnvKey,
+    g_adaptiveEnvKey,
+    g_preciseWaitEnvKey,
+    g_pacingEnvKey,
+    g_catchUpEnvKey,
+    g_limiterModeEnvKey,
+    g_presentWaitEnvKey,
+    g_maxFramesInFlightEnvKey,
+    g_filterEnvKey,
+    g_mipLodBiasEnvKey,
+    g_anisotropyEnvKey,
+    g_samplerRulesEnvKey,
+    g_samplerRulesFileEnvKey,
+    g_minImageCountEnvKey,
+    g_presentModeEnvKey,
+    g_preferMailboxPresentModeEnvKey,
+};
+
+static unique_ptr<Tracer> g_tracer; // destroyed after the external control thread which flushes it
 static unique_ptr<ExternalControl> g_externalControl;
 static bool g_externalControlVerbose = false;
-
-#ifdef SW
-    static pthread_t g_drawThr = 0;
-    static pair<uintptr_t, uintptr_t> g_drawInfo; // [draw count per image acquire, draw vertices per image acquire]
-    static shared_mutex g_drawInfoMutex;
-#endif
-
-struct InstanceData
+static bool g_printStats = false;
+static unique_ptr<Telemetry> g_telemetry;
+static unique_ptr<FrameLog> g_frameLog;
+static unique_ptr<CoordinatorClient> g_coordinatorClient;
+static unique_ptr<ProfileDatabase> g_profileDatabase;
+static unique_ptr<Governor> g_governor;
+static atomic<double> g_governorFramerate = 0.0; // cap on top of the configured framerate, "0" - no cap
+static atomic<double> g_coordinatorFramerate = 0.0; // cap from "flimes-coordinator", "0" - no cap
+static bool g_drawCounters = false; // hook draw and dispatch commands
+static bool g_samplerCache = false; // share identical samplers, hooks "vkDestroySampler"
+static unique_ptr<LoadDetector> g_loadDetector;
+
+constexpr uint64_t g_presentWaitTimeout = 100'000'000; // don't block forever e.g. when the window is hidden
+constexpr uint64_t g_frameFenceTimeout = 1'000'000'000; // don't block forever e.g. on device lost
+
+// Non-blocking present mode used instead of the config one while loading, "VK_PRESENT_MODE_MAX_ENUM_KHR" - none
+static atomic<VkPresentModeKHR> g_loadPresentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+
+struct InstanceData : InstanceDispatch
 {
     PFN_vkGetInstanceProcAddr getProcAddr = nullptr;
 
-    PFN_vkGetPhysicalDeviceProperties getPhysicalDeviceProperties = nullptr;
-    PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR getPhysicalDeviceSurfaceCapabilitiesKHR = nullptr;
-    PFN_vkGetPhysicalDeviceSurfacePresentModesKHR getPhysicalDeviceSurfacePresentModesKHR = nullptr;
-    PFN_vkCreateDevice createDevice = nullptr;
-    PFN_vkDestroyInstance destroyInstance = nullptr;
-
     set<VkPhysicalDevice> physicalDevices;
 };
 static map<VkInstance, shared_ptr<InstanceData>> g_instances;
 static shared_mutex g_instancesMutex;
 
-struct DeviceData
+struct SwapchainData
+{
+    optional<FrameLimiter> frameLimiter;
+    uint64_t configVersion = 0; // config the frame limiter was updated with
+    atomic<bool> resetFrameLimiter = false;
+    atomic<bool> framerateChanged = false; // apply the new framerate keeping the pacing phase
+    FrameLimiter::frame_clock::time_point frameStartTime; // "0" - not measured, e.g. the frame limiter was skipped
+    FrameLimiter::duration blockedTime = FrameLimiter::duration::zero(); // in the driver acquire and present since the last present
+    FrameLimiter::duration predictedWorkTime = FrameLimiter::duration::zero();
+
+    double refreshRate = 0.0; // queried when the swapchain is created for auto and adaptive framerate
+    double autoFramerate = 0.0; // derived from the refresh rate when the swapchain is created
+    AdaptiveFramerate adaptiveFramerate; // used by the presenting thread
+
+    FrameStats stats;
+    FrameStats::Totals coordinatorTotals; // last report, used by the external control thread only
+
+    vector<VkPresentModeKHR> presentModes;
+
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    atomic<bool> presentModeChanged = false;
+
+    uint32_t imageCount = 0;
+
+    uint64_t presentId = 0; // last presented ID, acquire and present are externally synchronized per swapchain
+    uint64_t lastPresentId = 0; // last ID passed to the driver, also for failed presents
+
+    // Ring of fences signaled when the GPU finishes the presented frame, "maxFramesInFlight" size
+    struct FrameFence
+    {
+        VkFence fence = VK_NULL_HANDLE;
+        bool pending = false;
+    };
+    vector<FrameFence> frameFences;
+    uint64_t submittedFrames = 0;
+    vector<VkSemaphore> presentSemaphores; // per image, the present waits on it instead of the application semaphores
+
+    DrawCounters::Counts initialDrawCounts; // when the swapchain was created, for statistics
+    DrawCounters::Counts drawCounts; // at the last present, counted on the load detector thread
+    LoadDetector::FrameInfo frameInfo; // last frame
+    bool loading = false; // framerate is unlocked by the load detector
+
+    shared_ptr<FrameLog::Source> frameLog;
+};
+
+struct DeviceData : DeviceDispatch
 {
     PFN_vkGetDeviceProcAddr getProcAddr = nullptr;
 
-    PFN_vkCreateSampler createSampler = nullptr;
-    PFN_vkCreateSwapchainKHR createSwapchainKHR = nullptr;
-#ifdef SW
-    PFN_vkCmdDraw cmdDraw = nullptr;
-#endif
-    PFN_vkAcquireNextImageKHR acquireNextImageKHR = nullptr;
-    PFN_vkAcquireNextImage2KHR acquireNextImage2KHR = nullptr;
-    PFN_vkQueuePresentKHR queuePresentKHR = nullptr;
-    PFN_vkDestroyDevice destroyDevice = nullptr;
+    VkDevice device = VK_NULL_HANDLE;
 
     weak_ptr<InstanceData> instanceData;
 
@@ -106,26 +222,53 @@ struct DeviceData
     float maxSamplerLodBias = 0.0f;
     float maxSamplerAnisotropy = 1.0f;
 
-    optional<FrameLimiter> frameLimiter;
-
-    vector<VkPresentModeKHR> presentModes;
+    unique_ptr<SamplerCache> samplerCache;
 
-    optional<VkPresentModeKHR> currentPresentMode;
-    bool presentModeChanged = false;
+    bool displayTiming = false; // "VK_GOOGLE_display_timing" is enabled
+    bool presentWait = false; // "VK_KHR_present_id" and "VK_KHR_present_wait" are enabled
+    double lastAutoFramerate = 0.0;
 
-#ifdef SW
-    struct
-    {
-        bool wasLoading = false;
-        optional<chrono::time_point<FrameLimiter::frame_clock>> loadedTimePoint;
-        bool configPresentModeChanged = false;
-    } sw;
-#endif
+    map<VkSwapchainKHR, shared_ptr<SwapchainData>> swapchains; // modified under exclusive "g_devicesMutex" lock
+    HandleMap<SwapchainData, HandleKey> swapchainsDispatch;
 };
-static map<VkDevice, shared_ptr<DeviceData>> g_devices;
-static map<VkQueue, shared_ptr<DeviceData>> g_queues;
+static map<VkDevice, shared_ptr<DeviceData>> g_devices; // modified under exclusive "g_devicesMutex" lock
+static DispatchMap<DeviceData> g_devicesDispatch; // lock-free lookup for devices, queues and command buffers
 static shared_mutex g_devicesMutex;
 
+// "g_devicesMutex" must be locked
+template<typename Fn>
+static void forEachSwapchain(Fn &&fn)
+{
+    for (auto &&[device, deviceData] : g_devices)
+    {
+        for (auto &&[swapchain, swapchainData] : deviceData->swapchains)
+            fn(swapchain, swapchainData.get());
+    }
+}
+
+static void printStats(VkSwapchainKHR swapchain, const SwapchainData *swapchainData)
+{
+    cerr << VK_LAYER_FLIMES_NAME << " swapchain " << swapchain << " stats: " << swapchainData->stats.summary();
+    if (g_drawCounters)
+    {
+        // Commands recorded by all threads since the swapchain was created
+        const auto counts = DrawCounters::collect() - swapchainData->initialDrawCounts;
+        const double frames = max<uint64_t>(swapchainData->stats.totals().frames, 1);
+        cerr << ", draws per frame: " << counts.draws / frames << ", dispatches per frame: " << counts.dispatches / frames;
+    }
+    cerr << endl;
+}
+static void printSamplerCacheStats(VkDevice device, const DeviceData *deviceData)
+{
+    const auto stats = deviceData->samplerCache->stats();
+    cerr << VK_LAYER_FLIMES_NAME << " device " << device << " sampler cache: "
+         << stats.hits << "/" << stats.requests << " hits (" << 100.0 * stats.hits / max<uint64_t>(stats.requests, 1) << "%)"
+         << ", " << stats.samplers << " samplers"
+         << ", " << stats.bypassed << " bypassed"
+         << endl
+    ;
+}
+
 static const map<string_view, VkPresentModeKHR> g_presentModes {
     {"IMMEDIATE", VK_PRESENT_MODE_IMMEDIATE_KHR},
     {"MAILBOX", VK_PRESENT_MODE_MAILBOX_KHR},
@@ -133,81 +276,276 @@ static const map<string_view, VkPresentModeKHR> g_presentModes {
     {"FIFO_RELAXED", VK_PRESENT_MODE_FIFO_RELAXED_KHR},
 };
 
+// Immutable snapshot, published as a new version on every change
 struct Config
 {
-    enum class Filter
+    enum class LimiterMode
     {
-        Nearest,
-        Trilinear,
+        Acquire, // wait after image acquire
+        Present, // wait after present, so the next frame starts as late as possible
+        Predictive, // like "Present", but wake up so the frame ends at the deadline
     };
 
-#ifdef SW
-    bool isSw = false;
-#endif
-
     double framerate = 0.0;
-
-    optional<Filter> filter;
-    optional<float> mipLodBias;
-    float maxAnisotropy = 0.0f;
+    bool autoFramerate = false; // derive framerate from the display refresh rate
+    double autoFramerateOffset = 3.0;
+    uint32_t autoFramerateDivisor = 1;
+    double refreshRate = 0.0; // used when the refresh rate can't be queried
+    bool adaptiveFramerate = false; // lower the framerate to a sustainable step
+    FrameLimiter::Options frameLimiterOptions = {};
+    LimiterMode limiterMode = LimiterMode::Acquire;
+    uint32_t presentWaitFrames = 0; // wait until frame "N - presentWaitFrames" is displayed before acquiring frame "N"
+    uint32_t maxFramesInFlight = 0; // wait until frame "N - maxFramesInFlight" is finished by GPU before acquiring frame "N"
+
+    SamplerOverride samplerOverride; // used when no sampler rule matches
+    SamplerRules samplerRules;
 
     uint32_t minImageCount = 0;
     optional<VkPresentModeKHR> presentMode;
     bool preferMailboxPresentMode = false;
+
+    uint64_t version = 0;
 };
-static Config g_config = [] {
-    Config config;
 
-    cerr << boolalpha << VK_LAYER_FLIMES_NAME << " v" << VK_LAYER_FLIMES_VERSION << " active" << "\n";
+static mutex g_configMutex; // serializes config changes, locked after "g_devicesMutex"
+static ProfileDatabase::Settings g_profile; // modified under "g_configMutex"
+static ProfileDatabase::Settings g_runtimeSettings; // set by the external control, modified under "g_configMutex"
 
-#ifdef SW
-    config.isSw = (strcasestr(program_invocation_name, "SoulWorker") != nullptr) && (strcasestr(program_invocation_name, ".exe") != nullptr);
-#endif
+// Runtime settings take precedence over environment variables, environment variables take precedence over profile settings
+static const char *getSetting(const ProfileDatabase::Settings &profile, const char *envKey)
+{
+    constexpr string_view prefix = "VK_LAYER_FLIMES_";
+    const auto key = string_view(envKey).substr(prefix.size());
 
-    if (auto env = getenv(g_framerateEnvKey); env && *env)
+    for (auto &&[runtimeKey, value] : g_runtimeSettings)
     {
-        config.framerate = atof(env);
-        if (config.framerate > 0.0)
-            cerr << "  Framerate: " << config.framerate << "\n";
+        if (runtimeKey == key)
+            return value.c_str();
     }
 
-    if (auto env = getenv(g_filterEnvKey); env && *env)
+    if (auto env = getenv(envKey); env && *env)
+        return env;
+
+    for (auto it = profile.rbegin(); it != profile.rend(); ++it)
     {
-        const map<string_view, Config::Filter> filters {
-            {"NEAREST", Config::Filter::Nearest},
-            {"TRILINEAR", Config::Filter::Trilinear},
+        if (it->first == key && !it->second.empty())
+            return it->second.c_str();
+    }
+
+    return nullptr;
+}
+
+// Strict checks for reporting invalid values, the values are still parsed with "atof()" and "atoi()"
+static bool isNumber(const char *str)
+{
+    char *end = nullptr;
+    const double value = strtod(str, &end);
+    return (end != str && *end == '\0' && isfinite(value));
+}
+static bool isInteger(const char *str)
+{
+    char *end = nullptr;
+    errno = 0;
+    const long value = strtol(str, &end, 10);
+    return (end != str && *end == '\0' && errno == 0 && value >= numeric_limits<int>::min() && value <= numeric_limits<int>::max());
+}
+
+// Invalid values are ignored, "invalidKeys" gets their keys without prefix
+static Config parseConfig(const ProfileDatabase::Settings &profile, ostream &log, vector<string> *invalidKeys = nullptr)
+{
+    Config config;
+
+    const auto invalid = [&](const char *envKey, const char *value) {
+        log << "  Invalid " << envKey << ": " << value << "\n";
+        if (invalidKeys)
+            invalidKeys->emplace_back(envKey + strlen("VK_LAYER_FLIMES_"));
+    };
+
+    if (auto env = getSetting(profile, g_framerateEnvKey))
+    {
+        if (strcasecmp(env, "AUTO") == 0)
+        {
+            config.autoFramerate = true;
+            log << "  Framerate: AUTO\n";
+        }
+        else
+        {
+            if (!isNumber(env))
+                invalid(g_framerateEnvKey, env);
+            config.framerate = atof(env);
+            if (config.framerate > 0.0)
+                log << "  Framerate: " << config.framerate << "\n";
+        }
+    }
+    if (auto env = getSetting(profile, g_autoFramerateOffsetEnvKey))
+    {
+        if (!isNumber(env))
+            invalid(g_autoFramerateOffsetEnvKey, env);
+        config.autoFramerateOffset = max(0.0, atof(env));
+        if (config.autoFramerate)
+            log << "  Auto framerate offset: " << config.autoFramerateOffset << "\n";
+    }
+    if (auto env = getSetting(profile, g_autoFramerateDivisorEnvKey))
+    {
+        if (!isInteger(env))
+            invalid(g_autoFramerateDivisorEnvKey, env);
+        config.autoFramerateDivisor = max(1, atoi(env));
+        if (config.autoFramerate)
+            log << "  Auto framerate divisor: " << config.autoFramerateDivisor << "\n";
+    }
+    if (auto env = getSetting(profile, g_refreshRateEnvKey))
+    {
+        if (!isNumber(env))
+            invalid(g_refreshRateEnvKey, env);
+        config.refreshRate = atof(env);
+        if (config.refreshRate > 0.0)
+            log << "  Refresh rate: " << config.refreshRate << "\n";
+    }
+    if (auto env = getSetting(profile, g_adaptiveEnvKey))
+    {
+        if (!isInteger(env))
+            invalid(g_adaptiveEnvKey, env);
+        config.adaptiveFramerate = (atoi(env) > 0);
+        if (config.adaptiveFramerate)
+            log << "  Adaptive framerate\n";
+    }
+    if (auto env = getSetting(profile, g_preciseWaitEnvKey))
+    {
+        if (!isInteger(env))
+            invalid(g_preciseWaitEnvKey, env);
+        config.frameLimiterOptions.preciseWait = (atoi(env) > 0);
+        if (config.frameLimiterOptions.preciseWait)
+            log << "  Precise wait\n";
+    }
+    if (auto env = getSetting(profile, g_pacingEnvKey))
+    {
+        if (strcasecmp(env, "GRID") == 0)
+        {
+            config.frameLimiterOptions.pacing = FrameLimiter::Pacing::Grid;
+            log << "  Pacing: GRID\n";
+        }
+        else if (strcasecmp(env, "CHAINED") != 0)
+        {
+            invalid(g_pacingEnvKey, env);
+        }
+    }
+    if (auto env = getSetting(profile, g_catchUpEnvKey))
+    {
+        if (strcasecmp(env, "SKIP") == 0)
+        {
+            config.frameLimiterOptions.catchUp = FrameLimiter::CatchUp::Skip;
+        }
+        else if (strcasecmp(env, "RESET") == 0)
+        {
+            config.frameLimiterOptions.catchUp = FrameLimiter::CatchUp::Reset;
+        }
+        else if (const int frames = atoi(env); frames > 0)
+        {
+            if (!isInteger(env))
+                invalid(g_catchUpEnvKey, env);
+            config.frameLimiterOptions.catchUp = FrameLimiter::CatchUp::Frames;
+            config.frameLimiterOptions.catchUpFrames = frames;
+        }
+        else
+        {
+            invalid(g_catchUpEnvKey, env);
+        }
+        if (config.frameLimiterOptions.pacing == FrameLimiter::Pacing::Grid)
+            log << "  Catch up: " << env << "\n";
+    }
+    if (auto env = getSetting(profile, g_limiterModeEnvKey))
+    {
+        const map<string_view, Config::LimiterMode> limiterModes {
+            {"ACQUIRE", Config::LimiterMode::Acquire},
+            {"PRESENT", Config::LimiterMode::Present},
+            {"PREDICTIVE", Config::LimiterMode::Predictive},
         };
 
-        string filterStr;
+        string limiterModeStr;
         while (*env)
-            filterStr.push_back(toupper(*(env++)));
+            limiterModeStr.push_back(toupper(*(env++)));
 
-        auto filterIt = filters.find(filterStr);
-        if (filterIt != filters.end())
+        auto limiterModeIt = limiterModes.find(limiterModeStr);
+        if (limiterModeIt != limiterModes.end())
         {
-            config.filter = filterIt->second;
-            cerr << "  Texture filtering: " << filterIt->first << "\n";
+            config.limiterMode = limiterModeIt->second;
+            log << "  Limiter mode: " << limiterModeIt->first << "\n";
+        }
+        else
+        {
+            invalid(g_limiterModeEnvKey, limiterModeStr.c_str());
         }
     }
-    if (auto env = getenv(g_mipLodBiasEnvKey); env && *env)
+
+    if (auto env = getSetting(profile, g_presentWaitEnvKey))
     {
-        config.mipLodBias = atof(env);
-        cerr << "  Mip LOD bias: " << *config.mipLodBias << "\n";
+        if (!isInteger(env))
+            invalid(g_presentWaitEnvKey, env);
+        config.presentWaitFrames = max(0, atoi(env));
+        if (config.presentWaitFrames > 0)
+            log << "  Present wait: " << config.presentWaitFrames << "\n";
     }
-    if (auto env = getenv(g_anisotropyEnvKey); env && *env)
+    if (auto env = getSetting(profile, g_maxFramesInFlightEnvKey))
     {
-        config.maxAnisotropy = atof(env);
-        if (config.maxAnisotropy >= 1.0f)
-            cerr << "  Max anisotropy: " << config.maxAnisotropy << "\n";
+        if (!isInteger(env))
+            invalid(g_maxFramesInFlightEnvKey, env);
+        config.maxFramesInFlight = max(0, atoi(env));
+        if (config.maxFramesInFlight > 0)
+            log << "  Max frames in flight: " << config.maxFramesInFlight << "\n";
     }
 
-    if (auto env = getenv(g_minImageCountEnvKey); env && *env)
+    if (auto env = getSetting(profile, g_filterEnvKey))
+    {
+        config.samplerOverride.filter = SamplerOverride::parseFilter(env);
+        if (config.samplerOverride.filter)
+            log << "  Texture filtering: " << env << "\n";
+        else
+            invalid(g_filterEnvKey, env);
+    }
+    if (auto env = getSetting(profile, g_mipLodBiasEnvKey))
+    {
+        if (!isNumber(env))
+            invalid(g_mipLodBiasEnvKey, env);
+        config.samplerOverride.mipLodBias = atof(env);
+        log << "  Mip LOD bias: " << *config.samplerOverride.mipLodBias << "\n";
+    }
+    if (auto env = getSetting(profile, g_anisotropyEnvKey))
+    {
+        if (!isNumber(env))
+            invalid(g_anisotropyEnvKey, env);
+        if (atof(env) >= 1.0)
+        {
+            config.samplerOverride.maxAnisotropy = atof(env);
+            log << "  Max anisotropy: " << *config.samplerOverride.maxAnisotropy << "\n";
+        }
+    }
     {
+        // Inline rules are checked before rules from the file
+        string_view invalidRule;
+        if (auto env = getSetting(profile, g_samplerRulesEnvKey); env && !SamplerRules::parse(env, config.samplerRules, invalidRule))
+            invalid(g_samplerRulesEnvKey, string(invalidRule).c_str());
+        if (auto env = getSetting(profile, g_samplerRulesFileEnvKey))
+        {
+            ifstream file(env);
+            const string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+            if (!file)
+                invalid(g_samplerRulesFileEnvKey, env);
+            else if (!SamplerRules::parse(text, config.samplerRules, invalidRule))
+                invalid(g_samplerRulesFileEnvKey, string(invalidRule).c_str());
+        }
+        if (!config.samplerRules.empty())
+            log << "  Sampler rules: " << config.samplerRules.size() << "\n";
+    }
+
+    if (auto env = getSetting(profile, g_minImageCountEnvKey))
+    {
+        if (!isInteger(env))
+            invalid(g_minImageCountEnvKey, env);
         config.minImageCount = atoi(env);
         if (config.minImageCount > 0)
-            cerr << "  Min image count: " << config.minImageCount << "\n";
+            log << "  Min image count: " << config.minImageCount << "\n";
     }
-    if (auto env = getenv(g_presentModeEnvKey); env && *env)
+    if (auto env = getSetting(profile, g_presentModeEnvKey))
     {
         string presentModeStr;
         while (*env)
@@ -217,92 +555,602 @@ static Config g_config = [] {
         if (modesIt != g_presentModes.end())
         {
             config.presentMode = modesIt->second;
-            cerr << "  Present mode: " << modesIt->first << "\n";
+            log << "  Present mode: " << modesIt->first << "\n";
+        }
+        else if (presentModeStr != "AUTO")
+        {
+            invalid(g_presentModeEnvKey, presentModeStr.c_str());
         }
     }
-    if (auto env = getenv(g_preferMailboxPresentModeEnvKey); env && *env)
+    if (auto env = getSetting(profile, g_preferMailboxPresentModeEnvKey))
     {
+        if (!isInteger(env))
+            invalid(g_preferMailboxPresentModeEnvKey, env);
         config.preferMailboxPresentMode = (atoi(env) > 0);
         if (config.preferMailboxPresentMode)
-            cerr << "  Prefer MAILBOX present mode\n";
+            log << "  Prefer MAILBOX present mode\n";
     }
 
-    if (auto env = getenv(g_enableExternalControlKey); env && *env != '0')
+    return config;
+}
+
+static bool setRuntimeSetting(const string &key, const string &value);
+static bool applyConfig(Config config);
+static void reloadProfile();
+
+static Rcu<Config> g_config([] {
+    cerr << boolalpha << VK_LAYER_FLIMES_NAME << " v" << VK_LAYER_FLIMES_VERSION << " active" << "\n";
+
+    ProfileDatabase::Settings profile;
     {
-        g_externalControl = make_unique<ExternalControl>([](const string &str) {
-            optional<VkPresentModeKHR> newPresentMode;
-            string_view newPresentModeName;
-            if (str == "AUTO")
+        auto env = getenv(g_profilesEnvKey);
+        g_profileDatabase = make_unique<ProfileDatabase>((env && *env) ? filesystem::path(env) : ProfileDatabase::getDefaultPath(), getExecutableName());
+        profile = g_profileDatabase->load();
+        if (!profile.empty())
+            cerr << "  Profile: " << profile.size() << " settings\n";
+        g_profile = profile;
+    }
+
+    Config config = parseConfig(profile, cerr);
+
+    auto processExternalCommands = [](const vector<string> &commands) {
+        // Validate all commands first, so settings from one message are applied together or not at all
+        enum class Query
+        {
+            Fps,
+            PresentMode,
+            Stats,
+        };
+        const map<string_view, Query> queryNames {
+            {"FPS", Query::Fps},
+            {"PRESENT_MODE", Query::PresentMode},
+            {"STATS", Query::Stats},
+        };
+
+        vector<Query> queries;
+        bool printAllStats = false;
+        ProfileDatabase::Settings newSettings;
+        optional<bool> newTracing;
+
+        for (size_t i = 0; i < commands.size(); ++i)
+        {
+            const auto &str = commands[i];
+            if (str == "GET")
+            {
+                if (i + 1 >= commands.size())
+                    return "ERROR " + str + "\n";
+
+                auto it = queryNames.find(commands[++i]);
+                if (it == queryNames.end())
+                    return "ERROR " + str + " " + commands[i] + "\n";
+                queries.push_back(it->second);
+            }
+            else if (str == "STATS")
+            {
+                printAllStats = true;
+            }
+            else if (str == "TRACE_START" || str == "TRACE_STOP")
             {
-                newPresentModeName = str;
+                newTracing = (str == "TRACE_START");
+            }
+            else if (str == "AUTO" || g_presentModes.count(str) > 0)
+            {
+                newSettings.emplace_back("PRESENT_MODE", str);
+            }
+            else if (auto pos = str.find('='); pos != string::npos)
+            {
+                // Setting name without prefix, an empty value restores the environment or profile setting
+                auto key = str.substr(0, pos);
+                auto isConfigKey = [&](const char *envKey) {
+                    return (string_view(envKey).substr(strlen("VK_LAYER_FLIMES_")) == key);
+                };
+                if (none_of(begin(g_configEnvKeys), end(g_configEnvKeys), isConfigKey))
+                    return "ERROR " + str + "\n";
+                newSettings.emplace_back(move(key), str.substr(pos + 1));
+            }
+            else if (isNumber(str.c_str()))
+            {
+                newSettings.emplace_back("FRAMERATE", str);
             }
             else
             {
-                auto it = g_presentModes.find(str);
-                if (it != g_presentModes.end())
-                {
-                    newPresentMode = it->second;
-                    newPresentModeName = it->first;
-                }
+                return "ERROR " + str + "\n";
             }
+        }
+
+        // Values are checked by the config parser, runtime settings are modified only on the external control thread
+        if (!newSettings.empty())
+        {
+            scoped_lock configLock(g_configMutex);
 
-            if (!newPresentModeName.empty())
+            const auto runtimeSettings = g_runtimeSettings;
+            for (auto &&[key, value] : newSettings)
+                setRuntimeSetting(key, value);
+
+            ostringstream log;
+            vector<string> invalidKeys;
+            parseConfig(g_profile, log, &invalidKeys);
+
+            g_runtimeSettings = runtimeSettings;
+
+            for (auto &&[key, value] : newSettings)
             {
-                scoped_lock devicesLock(g_devicesMutex);
+                if (!value.empty() && find(invalidKeys.begin(), invalidKeys.end(), key) != invalidKeys.end())
+                    return "ERROR " + key + "=" + value + "\n";
+            }
+        }
 
-                bool changed = false;
-                for (auto &&[device, deviceData] : g_devices)
-                {
-                    if (!deviceData->currentPresentMode)
-                        continue;
+        const bool hasSettings = (!newSettings.empty() || newTracing);
 
-                    if ((!newPresentMode && g_config.presentMode) || (newPresentMode && deviceData->currentPresentMode != newPresentMode))
-                    {
-                        deviceData->presentModeChanged = true;
-                        changed = true;
-                    }
-                }
+        // Before the settings, so they aren't applied if the trace file can't be opened
+        if (newTracing && *newTracing)
+        {
+            // Created on the first use, only the external control thread uses it
+            if (!g_tracer)
+            {
+                g_tracer = make_unique<Tracer>(ExternalControl::getPath().concat(".json"));
+                g_externalControl->addTimer(chrono::milliseconds(100), [] {
+                    g_tracer->flush();
+                });
+            }
+            if (!g_tracer->start())
+                return string("ERROR TRACE_START\n");
+        }
+        else if (newTracing && g_tracer)
+        {
+            g_tracer->stop();
+        }
+
+        if (!newSettings.empty())
+        {
+            scoped_lock devicesLock(g_devicesMutex);
+            scoped_lock configLock(g_configMutex);
+
+            bool changed = false;
+            for (auto &&[key, value] : newSettings)
+                changed |= setRuntimeSetting(key, value);
 
-                if (g_externalControlVerbose && (changed || g_config.presentMode != newPresentMode))
-                    cerr << VK_LAYER_FLIMES_NAME << " new present mode: " << newPresentModeName << ", recreate swapchain: " << changed << endl;
+            // The same settings give the same config, it isn't published again
+            ostringstream log; // don't print all settings on every command
+            const bool recreateSwapchains = changed && applyConfig(parseConfig(g_profile, log));
 
-                g_config.presentMode = newPresentMode;
+            if (g_externalControlVerbose)
+            {
+                cerr << VK_LAYER_FLIMES_NAME << " new settings:";
+                for (auto &&[key, value] : newSettings)
+                    cerr << " " << key << "=" << value;
+                cerr << ", recreate swapchain: " << recreateSwapchains << endl;
             }
-            else try
+        }
+
+        shared_lock devicesLock(g_devicesMutex);
+
+        if (printAllStats)
+        {
+            forEachSwapchain(printStats);
+            for (auto &&[device, deviceData] : g_devices)
             {
-                const auto fps = stod(str);
-                if (g_config.framerate != fps)
-                {
-                    if (g_externalControlVerbose)
-                        cerr << VK_LAYER_FLIMES_NAME << " new framerate: " << fps << endl;
+                if (deviceData->samplerCache)
+                    printSamplerCacheStats(device, deviceData.get());
+            }
+        }
+
+        const auto config = g_config.get();
 
-                    scoped_lock devicesLock(g_devicesMutex);
-                    g_config.framerate = fps;
-                    for (auto &&[device, deviceData] : g_devices)
-                        deviceData->frameLimiter.reset();
+        ostringstream reply;
+        for (auto query : queries) switch (query)
+        {
+            case Query::Fps:
+                if (config->autoFramerate)
+                    reply << "FPS AUTO\n";
+                else
+                    reply << "FPS " << config->framerate << "\n";
+                break;
+            case Query::PresentMode:
+            {
+                string_view presentModeName = "AUTO";
+                for (auto &&[name, presentMode] : g_presentModes)
+                {
+                    if (config->presentMode == presentMode)
+                        presentModeName = name;
                 }
+                reply << "PRESENT_MODE " << presentModeName << "\n";
+                break;
+            }
+            case Query::Stats:
+                forEachSwapchain([&](VkSwapchainKHR swapchain, SwapchainData *swapchainData) {
+                    reply << "STATS " << swapchain << " " << swapchainData->stats.summary() << "\n";
+                });
+                for (auto &&[device, deviceData] : g_devices)
+                {
+                    if (!deviceData->samplerCache)
+                        continue;
+                    const auto stats = deviceData->samplerCache->stats();
+                    reply << "SAMPLER_CACHE " << device << " requests: " << stats.requests << ", hits: " << stats.hits << ", samplers: " << stats.samplers << ", bypassed: " << stats.bypassed << "\n";
+                }
+                break;
+        }
+        if (hasSettings || printAllStats || queries.empty())
+            reply << "OK\n";
+        return reply.str();
+    };
+
+    const bool enableExternalControl = [&] {
+        auto env = getSetting(profile, g_enableExternalControlKey);
+        return (env && *env != '0');
+    }();
+    const double coordinatorWeight = [&] {
+        auto env = getSetting(profile, g_coordinatorEnvKey);
+        return env ? atof(env) : 0.0;
+    }();
+    {
+        Governor::Settings settings;
+        if (auto env = getSetting(profile, g_governorEnvKey); env && !Governor::parseCurve(env, settings.curve))
+            cerr << "  Invalid governor curve: " << env << "\n";
+        if (auto env = getSetting(profile, g_governorBatteryEnvKey))
+            settings.batteryFramerate = max(atof(env), 0.0);
+        if (!settings.curve.empty() || settings.batteryFramerate > 0.0)
+        {
+            if (auto env = getSetting(profile, g_governorHysteresisEnvKey))
+                settings.hysteresis = max(atof(env), 0.0);
+            if (auto env = getSetting(profile, g_governorThermalZoneEnvKey))
+                settings.thermalZoneType = env;
+            if (auto env = getSetting(profile, g_governorSysfsEnvKey))
+                settings.sysfsRoot = env;
+
+            cerr << "  Governor:";
+            for (auto &&step : settings.curve)
+                cerr << " " << step.temperature << "C:" << step.framerate;
+            if (!settings.curve.empty())
+                cerr << ", hysteresis: " << settings.hysteresis << "C";
+            if (settings.batteryFramerate > 0.0)
+                cerr << ", battery: " << settings.batteryFramerate;
+            cerr << "\n";
+
+            g_governor = make_unique<Governor>(settings);
+        }
+    }
+
+    {
+        auto env = getSetting(profile, g_traceEnvKey);
+        if (env && *env != '0')
+        {
+            g_tracer = make_unique<Tracer>((strcmp(env, "1") != 0) ? filesystem::path(env) : ExternalControl::getPath().concat(".json"));
+            g_tracer->start();
+        }
+    }
+
+    const int profileWatchFd = g_profileDatabase->watch();
+    if (enableExternalControl || coordinatorWeight > 0.0 || g_governor || g_tracer || profileWatchFd > -1)
+    {
+        g_externalControl = enableExternalControl
+            ? make_unique<ExternalControl>(processExternalCommands)
+            : make_unique<ExternalControl>(nullptr)
+        ;
+    }
+    if (coordinatorWeight > 0.0)
+    {
+        cerr << "  Coordinator weight: " << coordinatorWeight << "\n";
+
+        g_coordinatorClient = make_unique<CoordinatorClient>(coordinatorWeight);
+        g_externalControl->addTimer(chrono::seconds(1), [] {
+            // Report the swapchain with the most frames since the last report
+            CoordinatorClient::Report report;
+            {
+                shared_lock devicesLock(g_devicesMutex);
+
+                uint64_t maxFrames = 0;
+                forEachSwapchain([&](VkSwapchainKHR, SwapchainData *swapchainData) {
+                    const auto totals = swapchainData->stats.totals();
+                    const auto &prev = swapchainData->coordinatorTotals;
+                    const auto frames = totals.frames - prev.frames;
+                    const auto frameTime = totals.frameTime - prev.frameTime;
+                    if (frames > maxFrames && frameTime.count() > 0)
+                    {
+                        maxFrames = frames;
+                        report.fps = frames / chrono::duration<double>(frameTime).count();
+                        report.frameCostUs = chrono::duration<double, micro>(frameTime - (totals.sleepTime - prev.sleepTime)).count() / frames;
+                    }
+                    swapchainData->coordinatorTotals = totals;
+                });
             }
-            catch (const invalid_argument &)
-            {}
+
+            const auto cap = g_coordinatorClient->update(report);
+            if (!cap || *cap == g_coordinatorFramerate.load(memory_order_relaxed))
+                return;
+
+            shared_lock devicesLock(g_devicesMutex);
+            g_coordinatorFramerate = *cap;
+            forEachSwapchain([](VkSwapchainKHR, SwapchainData *swapchainData) {
+                swapchainData->framerateChanged = true;
+            });
+        });
+    }
+    if (g_tracer)
+    {
+        g_externalControl->addTimer(chrono::milliseconds(100), [] {
+            g_tracer->flush();
+        });
+    }
+    if (g_governor)
+    {
+        g_externalControl->addTimer(chrono::seconds(1), [] {
+            const auto state = g_governor->update();
+            if (state.framerate == g_governorFramerate.load(memory_order_relaxed))
+                return;
+
+            cerr << VK_LAYER_FLIMES_NAME << " governor framerate: " << state.framerate;
+            if (state.temperature)
+                cerr << ", temperature: " << *state.temperature << "C";
+            if (state.onBattery)
+                cerr << ", on battery";
+            cerr << endl;
+
+            shared_lock devicesLock(g_devicesMutex);
+            g_governorFramerate = state.framerate;
+            forEachSwapchain([](VkSwapchainKHR, SwapchainData *swapchainData) {
+                swapchainData->framerateChanged = true;
+            });
+        });
+    }
+    if (profileWatchFd > -1)
+    {
+        g_externalControl->addFd(profileWatchFd, [] {
+            if (g_profileDatabase->readChanges())
+                reloadProfile();
         });
     }
-    if (auto env = getenv(g_externalControlVerboseKey); env && *env != '0')
+    if (auto env = getSetting(profile, g_externalControlVerboseKey); env && *env != '0')
     {
         g_externalControlVerbose = true;
     }
+    if (auto env = getSetting(profile, g_statsEnvKey); env && *env != '0')
+    {
+        g_printStats = true;
+    }
+    if (auto env = getSetting(profile, g_telemetryEnvKey); env && *env != '0')
+    {
+        g_telemetry = make_unique<Telemetry>();
+        if (!g_telemetry->isOpen())
+            g_telemetry.reset();
+    }
+    if (auto env = getSetting(profile, g_frameLogEnvKey); env && *env != '0')
+    {
+        FrameLog::Settings settings;
+        settings.path = (strcmp(env, "1") == 0) ? ExternalControl::getPath().concat(".flog") : filesystem::path(env);
+        if (auto sizeEnv = getSetting(profile, g_frameLogMaxSizeEnvKey); sizeEnv && atoi(sizeEnv) > 0)
+            settings.maxFileSize = static_cast<uint64_t>(atoi(sizeEnv)) << 20;
+        if (auto directEnv = getSetting(profile, g_frameLogDirectEnvKey); directEnv && *directEnv != '0')
+            settings.direct = true;
+
+        g_frameLog = make_unique<FrameLog>(settings);
+        if (!g_frameLog->isOpen())
+            g_frameLog.reset();
+    }
+    if (auto env = getSetting(profile, g_drawCountersEnvKey); env && *env != '0')
+    {
+        g_drawCounters = true;
+    }
+    if (auto env = getSetting(profile, g_samplerCacheEnvKey); env && *env != '0')
+    {
+        cerr << "  Sampler cache enabled\n";
+        g_samplerCache = true;
+    }
+    {
+        auto env = getSetting(profile, g_loadDetectorEnvKey);
+#ifdef SW
+        if (!env && strcasestr(program_invocation_name, "SoulWorker") != nullptr && strcasestr(program_invocation_name, ".exe") != nullptr)
+            env = "soulworker";
+#endif
+        LoadDetector::Settings settings;
+        if (env && *env != '0' && LoadDetector::parse(env, settings))
+        {
+            if (auto threadEnv = getSetting(profile, g_loadDetectorThreadEnvKey))
+                settings.threadName = threadEnv;
+            if (auto delayEnv = getSetting(profile, g_loadDetectorDelayEnvKey))
+                settings.releaseDelay = chrono::milliseconds(max(atoi(delayEnv), 0));
+
+            cerr << "  Load detector:";
+            for (auto &&signature : settings.signatures)
+                cerr << " " << signature;
+            if (settings.learn)
+                cerr << " auto";
+            if (!settings.threadName.empty())
+                cerr << ", thread: " << settings.threadName;
+            cerr << ", release delay: " << settings.releaseDelay.count() << " ms\n";
+
+            g_loadDetector = make_unique<LoadDetector>(settings);
+            g_drawCounters = true;
+        }
+        else if (env && *env != '0')
+        {
+            cerr << "  Invalid load detector: " << env << "\n";
+        }
+    }
 
     cerr << flush;
 
     return config;
+}());
+
+// The handlers use "g_config" and the settings above, so the thread is started after they're initialized
+[[maybe_unused]] static const bool g_externalControlStarted = [] {
+    if (!g_externalControl)
+        return false;
+    g_externalControl->start();
+    return true;
 }();
 
+// "g_configMutex" must be locked
+static void publishConfig(Config config)
+{
+    config.version = g_config.get()->version + 1;
+    g_config.publish(move(config));
+}
+
+// "g_configMutex" must be locked, an empty value removes the setting, returns true if the setting changed
+static bool setRuntimeSetting(const string &key, const string &value)
+{
+    const auto it = find_if(g_runtimeSettings.begin(), g_runtimeSettings.end(), [&](const auto &setting) {
+        return (setting.first == key);
+    });
+    if (it == g_runtimeSettings.end() ? value.empty() : it->second == value)
+        return false;
+
+    g_runtimeSettings.erase(remove_if(g_runtimeSettings.begin(), g_runtimeSettings.end(), [&](const auto &setting) {
+        return (setting.first == key);
+    }), g_runtimeSettings.end());
+    if (!value.empty())
+        g_runtimeSettings.emplace_back(key, value);
+    return true;
+}
+
+static bool swapchainSettingsDiffer(const Config &a, const Config &b)
+{
+    return
+        a.presentMode != b.presentMode ||
+        a.preferMailboxPresentMode != b.preferMailboxPresentMode ||
+        a.minImageCount != b.minImageCount ||
+        a.maxFramesInFlight != b.maxFramesInFlight ||
+        a.autoFramerate != b.autoFramerate ||
+        a.autoFramerateOffset != b.autoFramerateOffset ||
+        a.autoFramerateDivisor != b.autoFramerateDivisor ||
+        a.refreshRate != b.refreshRate ||
+        a.adaptiveFramerate != b.adaptiveFramerate
+    ;
+}
+
+// "g_devicesMutex" and "g_configMutex" must be locked, returns true if swapchains have to be recreated
+static bool applyConfig(Config config)
+{
+    const auto current = g_config.get();
+
+    // Swapchain settings are applied when the application recreates the swapchain,
+    // frame limiters pick up the new config on the next frame.
+    const bool recreateSwapchains = swapchainSettingsDiffer(config, *current);
+
+    publishConfig(move(config));
+
+    if (recreateSwapchains)
+    {
+        forEachSwapchain([](VkSwapchainKHR, SwapchainData *swapchainData) {
+            swapchainData->presentModeChanged = true;
+        });
+    }
+
+    return recreateSwapchains;
+}
+
+static void reloadProfile()
+{
+    scoped_lock devicesLock(g_devicesMutex);
+    scoped_lock configLock(g_configMutex);
+
+    // Also notified on changes in other profiles
+    auto profile = g_profileDatabase->load();
+    if (profile == g_profile)
+        return;
+
+    cerr << boolalpha << VK_LAYER_FLIMES_NAME << " profile changed" << "\n";
+
+    g_profile = move(profile);
+    applyConfig(parseConfig(g_profile, cerr));
+
+    cerr << flush;
+}
+
 /**/
 
-static void limitFramerate(DeviceData *deviceData)
+// Config present mode, or the non-blocking one while loading
+static optional<VkPresentModeKHR> getPresentMode(const Config &config)
+{
+    if (const auto loadPresentMode = g_loadPresentMode.load(memory_order_relaxed); loadPresentMode != VK_PRESENT_MODE_MAX_ENUM_KHR)
+        return loadPresentMode;
+    return config.presentMode;
+}
+
+// Just under the refresh rate keeps the framerate inside the VRR window without FIFO queueing,
+// an integer divisor of the refresh rate gives even pacing at a lower framerate.
+static double getAutoFramerate(const Config &config, const double refreshRate)
+{
+    if (refreshRate <= 0.0)
+        return 0.0;
+    if (config.autoFramerateDivisor > 1)
+        return refreshRate / config.autoFramerateDivisor;
+    return max(1.0, refreshRate - config.autoFramerateOffset);
+}
+// Configured framerate with the governor and coordinator caps
+static double getMaxFramerate(const Config &config, const SwapchainData *swapchainData)
+{
+    double framerate = config.autoFramerate ? swapchainData->autoFramerate : config.framerate;
+    for (const double cap : {g_governorFramerate.load(memory_order_relaxed), g_coordinatorFramerate.load(memory_order_relaxed)})
+    {
+        if (cap > 0.0 && (framerate <= 0.0 || cap < framerate))
+            framerate = cap;
+    }
+    return framerate;
+}
+static double getFramerate(const Config &config, const SwapchainData *swapchainData)
+{
+    const double framerate = getMaxFramerate(config, swapchainData);
+    if (config.adaptiveFramerate && swapchainData->adaptiveFramerate.maxFramerate() == framerate)
+        return swapchainData->adaptiveFramerate.framerate();
+    return framerate;
+}
+
+// Returns the time spent in the frame limiter
+static FrameLimiter::duration limitFramerate(SwapchainData *swapchainData, const Config &config, const FrameLimiter::duration lead = FrameLimiter::duration::zero())
+{
+    if (swapchainData->resetFrameLimiter.load(memory_order_relaxed) && swapchainData->resetFrameLimiter.exchange(false, memory_order_acquire))
+        swapchainData->frameLimiter.reset();
+    bool framerateChanged = (swapchainData->framerateChanged.load(memory_order_relaxed) && swapchainData->framerateChanged.exchange(false, memory_order_acquire));
+    if (swapchainData->configVersion != config.version)
+    {
+        // New config keeps the pacing phase, unless the frame limiter options changed
+        if (swapchainData->frameLimiter && swapchainData->frameLimiter->options() != config.frameLimiterOptions)
+            swapchainData->frameLimiter.reset();
+        swapchainData->configVersion = config.version;
+        framerateChanged = true;
+    }
+    if (framerateChanged && swapchainData->frameLimiter)
+        swapchainData->frameLimiter->setFramerate(getFramerate(config, swapchainData));
+    if (!swapchainData->frameLimiter)
+        swapchainData->frameLimiter.emplace(getFramerate(config, swapchainData), config.frameLimiterOptions);
+
+    Tracer::Span span(Tracer::Name::FrameLimiter);
+    const auto waitStartTime = FrameLimiter::frame_clock::now();
+    swapchainData->frameLimiter->wait(lead);
+    const auto sleepTime = FrameLimiter::frame_clock::now() - waitStartTime;
+    swapchainData->stats.addSleep(sleepTime);
+    return sleepTime;
+}
+static void limitFramerateAfterPresent(SwapchainData *swapchainData, const Config &config)
+{
+    if (config.limiterMode == Config::LimiterMode::Predictive && swapchainData->frameStartTime.time_since_epoch().count() > 0)
+    {
+        // Fast attack, slow decay - prefer finishing slightly too early than too late
+        const auto workTime = FrameLimiter::frame_clock::now() - swapchainData->frameStartTime - swapchainData->blockedTime;
+        auto &predicted = swapchainData->predictedWorkTime;
+        if (workTime > predicted)
+            predicted = workTime;
+        else
+            predicted -= (predicted - workTime) / 16;
+        if (predicted > chrono::milliseconds(100))
+            predicted = chrono::milliseconds(100);
+
+        limitFramerate(swapchainData, config, predicted);
+    }
+    else
+    {
+        limitFramerate(swapchainData, config);
+    }
+    swapchainData->frameStartTime = FrameLimiter::frame_clock::now();
+    swapchainData->blockedTime = FrameLimiter::duration::zero();
+}
+static void skipFrameStart(SwapchainData *swapchainData)
 {
-    if (!deviceData->frameLimiter)
-        deviceData->frameLimiter.emplace(g_config.framerate);
-    deviceData->frameLimiter->wait();
+    swapchainData->frameStartTime = FrameLimiter::frame_clock::time_point();
+    swapchainData->blockedTime = FrameLimiter::duration::zero();
 }
 
 template<typename T>
@@ -314,54 +1162,161 @@ static T *getLayerCreateInfo(const void *pNext, VkStructureType type)
     return const_cast<T *>(layerCreateInfo);
 }
 
-#ifdef SW
-static bool isGameLoading(DeviceData *deviceData)
+static void waitForPresent(DeviceData *deviceData, VkDevice device, VkSwapchainKHR swapchain, SwapchainData *swapchainData, const uint32_t presentWaitFrames)
 {
-    if (!g_config.isSw)
-        return false;
+    // Next frame is "presentId + 1"
+    if (swapchainData->presentId < presentWaitFrames)
+        return;
 
-    bool isSwLoading = false;
+    deviceData->waitForPresentKHR(device, swapchain, swapchainData->presentId + 1 - presentWaitFrames, g_presentWaitTimeout);
+}
+
+// Can block, call without "g_devicesMutex" lock
+static void destroyFrameFences(DeviceData *deviceData, SwapchainData *swapchainData)
+{
+    // Fences and semaphores can't be destroyed while they're used by a queue submission, they're leaked if the wait fails
+    bool idle = true;
+    for (auto &&frameFence : swapchainData->frameFences)
     {
-        scoped_lock locker(g_drawInfoMutex);
-        if (g_drawThr != 0)
+        if (frameFence.fence == VK_NULL_HANDLE)
+            continue;
+
+        if (frameFence.pending && deviceData->waitForFences(deviceData->device, 1, &frameFence.fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS)
         {
-            auto &&[cnt, vert] = g_drawInfo;
-            if ((cnt == 1 && vert == 6) || (cnt == 2 && vert == 12) || (cnt == 3 && vert == 15))
-            {
-                isSwLoading = true;
-                deviceData->sw.wasLoading = true;
-            }
-            cnt = 0;
-            vert = 0;
+            idle = false;
+            continue;
         }
+        deviceData->destroyFence(deviceData->device, frameFence.fence, nullptr);
     }
-    if (!isSwLoading && deviceData->sw.wasLoading)
+    swapchainData->frameFences.clear();
+
+    for (auto &&semaphore : swapchainData->presentSemaphores)
     {
-        deviceData->sw.wasLoading = false;
-        deviceData->sw.loadedTimePoint = FrameLimiter::frame_clock::now();
+        if (semaphore != VK_NULL_HANDLE && idle)
+            deviceData->destroySemaphore(deviceData->device, semaphore, nullptr);
     }
-    if (!isSwLoading && deviceData->sw.loadedTimePoint.has_value())
+    swapchainData->presentSemaphores.clear();
+}
+static void createFrameFences(DeviceData *deviceData, SwapchainData *swapchainData, const uint32_t maxFramesInFlight)
+{
+    if (!deviceData->createFence || !deviceData->destroyFence || !deviceData->waitForFences || !deviceData->resetFences || !deviceData->queueSubmit)
+        return;
+
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    swapchainData->frameFences.resize(maxFramesInFlight);
+    for (auto &&frameFence : swapchainData->frameFences)
     {
-        const auto msAfterLoading = chrono::duration_cast<chrono::milliseconds>(FrameLimiter::frame_clock::now() - deviceData->sw.loadedTimePoint.value()).count();
-        if (msAfterLoading <= 2000)
+        if (deviceData->createFence(deviceData->device, &fenceCreateInfo, nullptr, &frameFence.fence) != VK_SUCCESS)
         {
-            // Keep unlocked framerate for a while
-            isSwLoading = true;
+            frameFence.fence = VK_NULL_HANDLE;
+            destroyFrameFences(deviceData, swapchainData);
+            return;
         }
-        else
+    }
+
+    // Optional, without them the fences cover only the work submitted to the present queue
+    if (!deviceData->createSemaphore || !deviceData->destroySemaphore)
+        return;
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    swapchainData->presentSemaphores.resize(swapchainData->imageCount, VK_NULL_HANDLE);
+    for (auto &&semaphore : swapchainData->presentSemaphores)
+    {
+        if (deviceData->createSemaphore(deviceData->device, &semaphoreCreateInfo, nullptr, &semaphore) != VK_SUCCESS)
         {
-            deviceData->sw.loadedTimePoint.reset();
+            semaphore = VK_NULL_HANDLE;
+            for (auto &&createdSemaphore : swapchainData->presentSemaphores)
+            {
+                if (createdSemaphore != VK_NULL_HANDLE)
+                    deviceData->destroySemaphore(deviceData->device, createdSemaphore, nullptr);
+            }
+            swapchainData->presentSemaphores.clear();
+            break;
         }
     }
-    if (isSwLoading
-            && deviceData->currentPresentMode.has_value()
-            && deviceData->currentPresentMode.value() != VK_PRESENT_MODE_IMMEDIATE_KHR
-            && deviceData->currentPresentMode.value() != VK_PRESENT_MODE_MAILBOX_KHR)
+}
+static void waitForFrameFence(DeviceData *deviceData, SwapchainData *swapchainData)
+{
+    // Frame "N - maxFramesInFlight" uses the same fence as the next frame "N"
+    auto &frameFence = swapchainData->frameFences[swapchainData->submittedFrames % swapchainData->frameFences.size()];
+    if (frameFence.pending)
+        deviceData->waitForFences(deviceData->device, 1, &frameFence.fence, VK_TRUE, g_frameFenceTimeout);
+}
+static void submitFrameFence(DeviceData *deviceData, VkQueue queue, SwapchainData *swapchainData)
+{
+    auto &frameFence = swapchainData->frameFences[swapchainData->submittedFrames % swapchainData->frameFences.size()];
+    if (frameFence.pending)
+    {
+        // Normally already signaled by the wait in acquire, a pending fence can't be reset - the frame is skipped
+        if (deviceData->waitForFences(deviceData->device, 1, &frameFence.fence, VK_TRUE, g_frameFenceTimeout) != VK_SUCCESS)
+            return;
+        if (deviceData->resetFences(deviceData->device, 1, &frameFence.fence) != VK_SUCCESS)
+            return;
+        frameFence.pending = false;
+    }
+
+    // Empty submission - the fence is signaled when all work submitted earlier to this queue is finished,
+    // including the submission chaining the present semaphores
+    if (deviceData->queueSubmit(queue, 0, nullptr, frameFence.fence) == VK_SUCCESS)
+    {
+        frameFence.pending = true;
+        ++swapchainData->submittedFrames;
+    }
+}
+/*
+    The semaphores the application present waits on are usually signaled by its last submissions, possibly to
+    other queues. They are waited in an empty submission to the present queue which signals a layer semaphore
+    for the present instead, so the frame fence submitted after it covers that work, too. An image semaphore
+    can be reused after the image is acquired again.
+*/
+static void chainPresentSemaphores(DeviceData *deviceData, VkQueue queue, VkPresentInfoKHR &presentInfo, SwapchainData *swapchainData, const uint32_t imageIndex)
+{
+    if (presentInfo.waitSemaphoreCount == 0 || imageIndex >= swapchainData->presentSemaphores.size())
+        return;
+
+    VkPipelineStageFlags localWaitStages[4];
+    vector<VkPipelineStageFlags> heapWaitStages;
+    VkPipelineStageFlags *waitStages = localWaitStages;
+    if (presentInfo.waitSemaphoreCount > size(localWaitStages))
+    {
+        heapWaitStages.resize(presentInfo.waitSemaphoreCount);
+        waitStages = heapWaitStages.data();
+    }
+    fill_n(waitStages, presentInfo.waitSemaphoreCount, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    auto &semaphore = swapchainData->presentSemaphores[imageIndex];
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = presentInfo.waitSemaphoreCount;
+    submitInfo.pWaitSemaphores = presentInfo.pWaitSemaphores;
+    submitInfo.pWaitDstStageMask = waitStages;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &semaphore;
+    if (deviceData->queueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        return;
+
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &semaphore;
+}
+
+// "g_devicesMutex" must be locked
+static bool updateLoading(SwapchainData *swapchainData)
+{
+    const bool loading = g_loadDetector->update(swapchainData->frameInfo, FrameLimiter::frame_clock::now());
+
+    if (loading
+            && swapchainData->presentMode != VK_PRESENT_MODE_IMMEDIATE_KHR
+            && swapchainData->presentMode != VK_PRESENT_MODE_MAILBOX_KHR)
     {
         // Disable blocking V-Sync (if enabled)
         bool hasImmediate = false;
         bool hasMailbox = false;
-        for (auto &&presentMode : deviceData->presentModes)
+        for (auto &&presentMode : swapchainData->presentModes)
         {
             if (presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
                 hasImmediate = true;
@@ -370,57 +1325,96 @@ static bool isGameLoading(DeviceData *deviceData)
         }
         if (hasImmediate || hasMailbox)
         {
-            g_config.presentMode = hasImmediate
+            const auto presentMode = hasImmediate
                 ? VK_PRESENT_MODE_IMMEDIATE_KHR
                 : VK_PRESENT_MODE_MAILBOX_KHR
             ;
-            deviceData->presentModeChanged = true;
-            deviceData->sw.configPresentModeChanged = true;
+
+            g_loadPresentMode = presentMode;
+            swapchainData->presentModeChanged = true;
         }
     }
-    else if (!isSwLoading && deviceData->sw.configPresentModeChanged)
+    else if (!loading && g_loadPresentMode.load(memory_order_relaxed) != VK_PRESENT_MODE_MAX_ENUM_KHR)
     {
-        g_config.presentMode.reset();
-        deviceData->presentModeChanged = true;
-        deviceData->sw.configPresentModeChanged = false;
+        // Restore the config present mode, also when the swapchain has been recreated while loading
+        if (g_loadPresentMode.exchange(VK_PRESENT_MODE_MAX_ENUM_KHR) != VK_PRESENT_MODE_MAX_ENUM_KHR)
+            swapchainData->presentModeChanged = true;
     }
-    if (isSwLoading)
+    if (loading)
     {
-        for (auto &&[device, deviceData] : g_devices)
-            deviceData->frameLimiter.reset();
+        forEachSwapchain([](VkSwapchainKHR, SwapchainData *swapchainData) {
+            swapchainData->resetFrameLimiter = true;
+        });
     }
 
-    return isSwLoading;
+    swapchainData->loading = loading;
+
+    return loading;
+}
+
+static void logFrame(SwapchainData *swapchainData, VkSwapchainKHR swapchain, FrameLogFormat::Event event, FrameLimiter::frame_clock::time_point time, FrameLimiter::duration frameTime, FrameLimiter::duration sleepTime)
+{
+    const auto toNs32 = [](FrameLimiter::duration d) {
+        return static_cast<uint32_t>(min<int64_t>(chrono::duration_cast<chrono::nanoseconds>(d).count(), numeric_limits<uint32_t>::max()));
+    };
+
+    FrameLogFormat::Record record = {};
+    record.timestampNs = chrono::duration_cast<chrono::nanoseconds>(time.time_since_epoch()).count();
+    record.swapchain = HandleKey::get(swapchain);
+    record.frameTimeNs = toNs32(frameTime);
+    record.sleepTimeNs = toNs32(sleepTime);
+    record.presentMode = swapchainData->presentMode;
+    record.event = event;
+    swapchainData->frameLog->push(record);
 }
-#endif
 
 template<typename Fn>
-static VkResult acquireNextImageCommon(VkDevice device, Fn &&fn)
+static VkResult acquireNextImageCommon(VkDevice device, VkSwapchainKHR swapchain, Fn &&fn)
 {
-    shared_lock devicesLock(g_devicesMutex);
+    Tracer::Span span(Tracer::Name::AcquireNextImage);
 
-    auto devicesIt = g_devices.find(device);
-    if (devicesIt == g_devices.end())
+    auto deviceData = g_devicesDispatch.find(device);
+    if (!deviceData)
         return VK_ERROR_INITIALIZATION_FAILED;
 
-    auto deviceData = devicesIt->second.get();
+    auto swapchainData = deviceData->swapchainsDispatch.find(swapchain);
+    if (!swapchainData)
+        return fn(deviceData);
 
-#ifdef SW
-    const bool gameLoading = isGameLoading(deviceData);
-#endif
+    const bool loading = g_loadDetector && [&] {
+        shared_lock devicesLock(g_devicesMutex);
+        return updateLoading(swapchainData);
+    }();
 
-    if (deviceData->presentModeChanged)
+    if (swapchainData->presentModeChanged)
         return VK_ERROR_OUT_OF_DATE_KHR;
 
+    auto config = g_config.get();
+
+    // Time blocked in acquire isn't frame work for the predictive frame limiter and adaptive framerate
+    const bool measureBlocking = (config->limiterMode == Config::LimiterMode::Predictive || config->adaptiveFramerate);
+    const auto blockStartTime = measureBlocking ? FrameLimiter::frame_clock::now() : FrameLimiter::frame_clock::time_point();
+
+    if (deviceData->presentWait && config->presentWaitFrames > 0)
+        waitForPresent(deviceData, device, swapchain, swapchainData, config->presentWaitFrames);
+    if (!swapchainData->frameFences.empty())
+        waitForFrameFence(deviceData, swapchainData);
+
     auto ret = fn(deviceData);
+
+    if (measureBlocking)
+        swapchainData->blockedTime += FrameLimiter::frame_clock::now() - blockStartTime;
+
     if (ret == VK_SUCCESS || ret == VK_SUBOPTIMAL_KHR)
     {
-#ifdef SW
-        if (!gameLoading)
-#endif
-        {
-            limitFramerate(deviceData);
-        }
+        // Loaded after the blocking calls
+        config = g_config.get();
+        const auto sleepTime = (config->limiterMode == Config::LimiterMode::Acquire && !loading)
+            ? limitFramerate(swapchainData, *config)
+            : FrameLimiter::duration::zero()
+        ;
+        if (swapchainData->frameLog)
+            logFrame(swapchainData, swapchain, FrameLogFormat::Event::Acquire, FrameLimiter::frame_clock::now(), FrameLimiter::duration::zero(), sleepTime);
     }
 
     return ret;
@@ -454,12 +1448,7 @@ static VkResult VKAPI_CALL vkCreateInstance(const VkInstanceCreateInfo *pCreateI
     instanceData = make_shared<InstanceData>();
 
     instanceData->getProcAddr = getInstanceProcAddr;
-
-    instanceData->getPhysicalDeviceProperties = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties>(getInstanceProcAddr(*pInstance, "vkGetPhysicalDeviceProperties"));
-    instanceData->getPhysicalDeviceSurfaceCapabilitiesKHR = reinterpret_cast<PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR>(getInstanceProcAddr(*pInstance, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR"));
-    instanceData->getPhysicalDeviceSurfacePresentModesKHR = reinterpret_cast<PFN_vkGetPhysicalDeviceSurfacePresentModesKHR>(getInstanceProcAddr(*pInstance, "vkGetPhysicalDeviceSurfacePresentModesKHR"));
-    instanceData->createDevice = reinterpret_cast<PFN_vkCreateDevice>(getInstanceProcAddr(*pInstance, "vkCreateDevice"));
-    instanceData->destroyInstance = reinterpret_cast<PFN_vkDestroyInstance>(getInstanceProcAddr(*pInstance, "vkDestroyInstance"));
+    instanceData->init(getInstanceProcAddr, *pInstance);
 
     auto enumeratePhysicalDevices = reinterpret_cast<PFN_vkEnumeratePhysicalDevices>(
         reinterpret_cast<PFN_vkGetInstanceProcAddr>(getInstanceProcAddr(*pInstance, "vkGetInstanceProcAddr"))(*pInstance, "vkEnumeratePhysicalDevices")
@@ -520,46 +1509,170 @@ static VkResult VKAPI_CALL vkCreateDevice(VkPhysicalDevice physicalDevice, const
     if (!instanceData->createDevice)
         return VK_ERROR_INITIALIZATION_FAILED;
 
+    auto createInfo = *pCreateInfo;
+    vector<const char *> enabledExtensions(createInfo.ppEnabledExtensionNames, createInfo.ppEnabledExtensionNames + createInfo.enabledExtensionCount);
+
+    auto isExtensionEnabled = [&](const char *name) {
+        for (auto &&extension : enabledExtensions)
+        {
+            if (strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    };
+    optional<vector<VkExtensionProperties>> supportedExtensions;
+    auto isExtensionSupported = [&](const char *name) {
+        if (!instanceData->enumerateDeviceExtensionProperties)
+            return false;
+
+        if (!supportedExtensions)
+        {
+            uint32_t nExtensions = 0;
+            instanceData->enumerateDeviceExtensionProperties(physicalDevice, nullptr, &nExtensions, nullptr);
+
+            supportedExtensions.emplace(nExtensions);
+            instanceData->enumerateDeviceExtensionProperties(physicalDevice, nullptr, &nExtensions, supportedExtensions->data());
+            supportedExtensions->resize(nExtensions);
+        }
+
+        for (auto &&extension : *supportedExtensions)
+        {
+            if (strcmp(extension.extensionName, name) == 0)
+                return true;
+        }
+        return false;
+    };
+
+    // Enabled whenever supported, "auto" and adaptive framerate and present wait can be enabled at runtime
+    bool displayTiming = isExtensionEnabled(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+    if (!displayTiming && isExtensionSupported(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME))
+    {
+        enabledExtensions.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+        displayTiming = true;
+    }
+
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+    // Application structures linked to the layer feature structures
+    pair<VkBaseOutStructure *, VkBaseOutStructure *> backupNext[2];
+    uint32_t nBackupNext = 0;
+
+    bool presentWait = false;
+    if (isExtensionSupported(VK_KHR_PRESENT_ID_EXTENSION_NAME) && isExtensionSupported(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+    {
+        auto getPhysicalDeviceFeatures2 = instanceData->getPhysicalDeviceFeatures2
+            ? instanceData->getPhysicalDeviceFeatures2
+            : instanceData->getPhysicalDeviceFeatures2KHR
+        ;
+        if (getPhysicalDeviceFeatures2)
+        {
+            VkPhysicalDeviceFeatures2 features = {};
+            features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features.pNext = &presentWaitFeatures;
+            presentWaitFeatures.pNext = &presentIdFeatures;
+            getPhysicalDeviceFeatures2(physicalDevice, &features);
+            presentWaitFeatures.pNext = nullptr;
+
+            presentWait = (presentIdFeatures.presentId && presentWaitFeatures.presentWait);
+        }
+    }
+    if (presentWait)
+    {
+        for (auto &&extension : {VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME})
+        {
+            if (!isExtensionEnabled(extension))
+                enabledExtensions.push_back(extension);
+        }
+
+        // Replace the application feature structures with enabled copies if they exist, otherwise add ours
+        bool hasPresentIdFeatures = false;
+        bool hasPresentWaitFeatures = false;
+        auto prev = reinterpret_cast<VkBaseOutStructure *>(&createInfo);
+        for (auto next = prev->pNext; next; prev = next, next = next->pNext)
+        {
+            VkBaseOutStructure *replacement = nullptr;
+            if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR && !hasPresentIdFeatures)
+            {
+                presentIdFeatures = *reinterpret_cast<VkPhysicalDevicePresentIdFeaturesKHR *>(next);
+                presentIdFeatures.presentId = VK_TRUE;
+                replacement = reinterpret_cast<VkBaseOutStructure *>(&presentIdFeatures);
+                hasPresentIdFeatures = true;
+            }
+            else if (next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR && !hasPresentWaitFeatures)
+            {
+                presentWaitFeatures = *reinterpret_cast<VkPhysicalDevicePresentWaitFeaturesKHR *>(next);
+                presentWaitFeatures.presentWait = VK_TRUE;
+                replacement = reinterpret_cast<VkBaseOutStructure *>(&presentWaitFeatures);
+                hasPresentWaitFeatures = true;
+            }
+            if (!replacement)
+                continue;
+
+            // Application structures are restored after "vkCreateDevice"
+            const bool layerOwned =
+                prev == reinterpret_cast<VkBaseOutStructure *>(&createInfo) ||
+                prev == reinterpret_cast<VkBaseOutStructure *>(&presentIdFeatures) ||
+                prev == reinterpret_cast<VkBaseOutStructure *>(&presentWaitFeatures)
+            ;
+            if (!layerOwned)
+                backupNext[nBackupNext++] = {prev, next};
+            prev->pNext = replacement;
+            next = replacement;
+        }
+        if (!hasPresentIdFeatures)
+        {
+            presentIdFeatures.pNext = const_cast<void *>(createInfo.pNext);
+            createInfo.pNext = &presentIdFeatures;
+        }
+        if (!hasPresentWaitFeatures)
+        {
+            presentWaitFeatures.pNext = const_cast<void *>(createInfo.pNext);
+            createInfo.pNext = &presentWaitFeatures;
+        }
+    }
+
+    createInfo.enabledExtensionCount = enabledExtensions.size();
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
+
     // Advance the link info for the next element of the chain
     layerDeviceCreateInfo->u.pLayerInfo = layerDeviceCreateInfo->u.pLayerInfo->pNext;
 
-    if (auto ret = instanceData->createDevice(physicalDevice, pCreateInfo, pAllocator, pDevice); ret != VK_SUCCESS)
+    const auto ret = instanceData->createDevice(physicalDevice, &createInfo, pAllocator, pDevice);
+
+    for (uint32_t i = 0; i < nBackupNext; ++i)
+        backupNext[i].first->pNext = backupNext[i].second;
+
+    if (ret != VK_SUCCESS)
         return ret;
 
     scoped_lock devicesLock(g_devicesMutex);
 
-    auto &deviceData = g_devices[*pDevice];
-    deviceData = make_shared<DeviceData>();
+    auto deviceData = make_shared<DeviceData>();
+    if (!g_devicesDispatch.insert(*pDevice, deviceData.get()))
+    {
+        if (auto destroyDevice = reinterpret_cast<PFN_vkDestroyDevice>(getDeviceProcAddr(*pDevice, "vkDestroyDevice")))
+            destroyDevice(*pDevice, pAllocator);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    g_devices[*pDevice] = deviceData;
 
     deviceData->getProcAddr = getDeviceProcAddr;
 
-    deviceData->createSampler = reinterpret_cast<PFN_vkCreateSampler>(getDeviceProcAddr(*pDevice, "vkCreateSampler"));
-    deviceData->createSwapchainKHR = reinterpret_cast<PFN_vkCreateSwapchainKHR>(getDeviceProcAddr(*pDevice, "vkCreateSwapchainKHR"));
-#ifdef SW
-    if (g_config.isSw)
-        deviceData->cmdDraw = reinterpret_cast<PFN_vkCmdDraw>(getDeviceProcAddr(*pDevice, "vkCmdDraw"));
-#endif
-    deviceData->acquireNextImageKHR = reinterpret_cast<PFN_vkAcquireNextImageKHR>(getDeviceProcAddr(*pDevice, "vkAcquireNextImageKHR"));
-    deviceData->acquireNextImage2KHR = reinterpret_cast<PFN_vkAcquireNextImage2KHR>(getDeviceProcAddr(*pDevice, "vkAcquireNextImage2KHR"));
-    deviceData->queuePresentKHR = reinterpret_cast<PFN_vkQueuePresentKHR>(getDeviceProcAddr(*pDevice, "vkQueuePresentKHR"));
-    deviceData->destroyDevice = reinterpret_cast<PFN_vkDestroyDevice>(getDeviceProcAddr(*pDevice, "vkDestroyDevice"));
+    deviceData->device = *pDevice;
 
-    auto vkGetDeviceQueue = reinterpret_cast<PFN_vkGetDeviceQueue>(getDeviceProcAddr(*pDevice, "vkGetDeviceQueue"));
-    for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; ++i)
-    {
-        const auto &queueCreateInfo = pCreateInfo->pQueueCreateInfos[i];
-        for (uint32_t j = 0; j < queueCreateInfo.queueCount; ++j)
-        {
-            VkQueue queue = VK_NULL_HANDLE;
-            vkGetDeviceQueue(*pDevice, queueCreateInfo.queueFamilyIndex, j, &queue);
-            g_queues[queue] = deviceData;
-        }
-    }
+    deviceData->init(getDeviceProcAddr, *pDevice);
 
     deviceData->instanceData = instanceData;
 
     deviceData->physicalDevice = physicalDevice;
 
+    deviceData->displayTiming = displayTiming;
+    deviceData->presentWait = (presentWait && deviceData->waitForPresentKHR);
+
     if (instanceData->getPhysicalDeviceProperties)
     {
         VkPhysicalDeviceProperties physicalDeviceProperties = {};
@@ -568,59 +1681,77 @@ static VkResult VKAPI_CALL vkCreateDevice(VkPhysicalDevice physicalDevice, const
         deviceData->maxSamplerAnisotropy = physicalDeviceProperties.limits.maxSamplerAnisotropy;
     }
 
+    if (g_samplerCache)
+        deviceData->samplerCache = make_unique<SamplerCache>();
+
     return VK_SUCCESS;
 }
 static VkResult VKAPI_CALL vkCreateSampler(VkDevice device, const VkSamplerCreateInfo *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkSampler *pSampler)
 {
-    shared_lock devicesLock(g_devicesMutex);
+    Tracer::Span span(Tracer::Name::CreateSampler);
 
-    auto devicesIt = g_devices.find(device);
-    if (devicesIt == g_devices.end())
+    auto deviceData = g_devicesDispatch.find(device);
+    if (!deviceData)
         return VK_ERROR_INITIALIZATION_FAILED;
 
-    auto deviceData = devicesIt->second.get();
-
     auto createInfo = *pCreateInfo;
 
-    if (g_config.filter) switch (*g_config.filter)
-    {
-        case Config::Filter::Nearest:
-            createInfo.magFilter = VK_FILTER_NEAREST;
-            createInfo.minFilter = VK_FILTER_NEAREST;
-            createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-            break;
-        case Config::Filter::Trilinear:
-            createInfo.magFilter = VK_FILTER_LINEAR;
-            createInfo.minFilter = VK_FILTER_LINEAR;
-            createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-            break;
-    }
-    if (g_config.mipLodBias)
-    {
-        createInfo.mipLodBias = min(*g_config.mipLodBias, deviceData->maxSamplerLodBias);
-    }
-    if (g_config.maxAnisotropy >= 1.0f)
+    // Rules match the application sampler
+    const auto config = g_config.get();
+    auto samplerOverride = config->samplerRules.find(createInfo);
+    if (!samplerOverride)
+        samplerOverride = &config->samplerOverride;
+    samplerOverride->apply(createInfo, deviceData->maxSamplerLodBias, deviceData->maxSamplerAnisotropy);
+
+    if (deviceData->samplerCache)
     {
-        createInfo.anisotropyEnable = VK_TRUE;
-        createInfo.maxAnisotropy = min(g_config.maxAnisotropy, deviceData->maxSamplerAnisotropy);
+        // Shared samplers are destroyed without the application allocator
+        if (auto key = !pAllocator ? SamplerCache::makeKey(createInfo) : nullopt)
+        {
+            return deviceData->samplerCache->acquire(move(*key), pSampler, [&](VkSampler *sampler) {
+                return deviceData->createSampler(device, &createInfo, nullptr, sampler);
+            });
+        }
+        deviceData->samplerCache->addBypassed();
     }
 
     return deviceData->createSampler(device, &createInfo, pAllocator, pSampler);
 }
+static void VKAPI_CALL vkDestroySampler(VkDevice device, VkSampler sampler, const VkAllocationCallbacks *pAllocator)
+{
+    auto deviceData = g_devicesDispatch.find(device);
+    if (!deviceData)
+        return;
+
+    if (deviceData->samplerCache && sampler != VK_NULL_HANDLE && deviceData->samplerCache->release(sampler) == SamplerCache::Release::Referenced)
+        return;
+
+    deviceData->destroySampler(device, sampler, pAllocator);
+}
 static VkResult VKAPI_CALL vkCreateSwapchainKHR(VkDevice device, const VkSwapchainCreateInfoKHR *pCreateInfo, const VkAllocationCallbacks *pAllocator, VkSwapchainKHR *pSwapchain)
 {
-    shared_lock devicesLock(g_devicesMutex);
+    Tracer::Span span(Tracer::Name::CreateSwapchain);
 
-    auto devicesIt = g_devices.find(device);
-    if (devicesIt == g_devices.end())
+    // The device can't be destroyed while its swapchain is being created, the driver call doesn't block other devices
+    auto deviceData = g_devicesDispatch.find(device);
+    if (!deviceData)
         return VK_ERROR_INITIALIZATION_FAILED;
 
-    auto deviceData = devicesIt->second.get();
-
     auto instanceData = deviceData->instanceData.lock();
     if (!instanceData)
         return VK_ERROR_INITIALIZATION_FAILED;
 
+    auto swapchainData = make_shared<SwapchainData>();
+    if (g_frameLog)
+        swapchainData->frameLog = g_frameLog->addSource();
+    if (g_drawCounters)
+        swapchainData->initialDrawCounts = DrawCounters::collect();
+    if (g_loadDetector)
+        swapchainData->drawCounts = DrawCounters::collect(g_loadDetector->settings().threadName);
+
+    // Compared with the current config when the swapchain is registered
+    const auto config = g_config.get();
+
     auto createInfo = *pCreateInfo;
 
     if (instanceData->getPhysicalDeviceSurfacePresentModesKHR)
@@ -628,102 +1759,229 @@ static VkResult VKAPI_CALL vkCreateSwapchainKHR(VkDevice device, const VkSwapcha
         uint32_t nPresentModes = 0;
         instanceData->getPhysicalDeviceSurfacePresentModesKHR(deviceData->physicalDevice, createInfo.surface, &nPresentModes, nullptr);
 
-        deviceData->presentModes.clear();
-        deviceData->presentModes.resize(nPresentModes);
-        instanceData->getPhysicalDeviceSurfacePresentModesKHR(deviceData->physicalDevice, createInfo.surface, &nPresentModes, deviceData->presentModes.data());
+        swapchainData->presentModes.resize(nPresentModes);
+        instanceData->getPhysicalDeviceSurfacePresentModesKHR(deviceData->physicalDevice, createInfo.surface, &nPresentModes, swapchainData->presentModes.data());
     }
 
-    if (g_config.presentMode || g_config.preferMailboxPresentMode)
+    const auto presentMode = getPresentMode(*config);
+    if (presentMode || config->preferMailboxPresentMode)
     {
-        for (auto &&supportedPresentMode : deviceData->presentModes)
+        for (auto &&supportedPresentMode : swapchainData->presentModes)
         {
-            if (g_config.presentMode && supportedPresentMode == *g_config.presentMode)
+            if (presentMode && supportedPresentMode == *presentMode)
             {
-                createInfo.presentMode = *g_config.presentMode;
+                createInfo.presentMode = *presentMode;
                 break;
             }
 
-            if (g_config.preferMailboxPresentMode && supportedPresentMode == VK_PRESENT_MODE_MAILBOX_KHR && createInfo.presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+            if (config->preferMailboxPresentMode && supportedPresentMode == VK_PRESENT_MODE_MAILBOX_KHR && createInfo.presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
             {
                 createInfo.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-                if (!g_config.presentMode)
+                if (!presentMode)
                     break;
             }
         }
     }
 
-    if (g_config.minImageCount > 0 && instanceData->getPhysicalDeviceSurfaceCapabilitiesKHR)
+    if (config->minImageCount > 0 && instanceData->getPhysicalDeviceSurfaceCapabilitiesKHR)
     {
         VkSurfaceCapabilitiesKHR surfaceCapabilities = {};
         if (instanceData->getPhysicalDeviceSurfaceCapabilitiesKHR(deviceData->physicalDevice, createInfo.surface, &surfaceCapabilities) == VK_SUCCESS)
         {
-            uint32_t minImageCount = max(g_config.minImageCount, surfaceCapabilities.minImageCount);
+            uint32_t minImageCount = max(config->minImageCount, surfaceCapabilities.minImageCount);
             if (surfaceCapabilities.maxImageCount > 0)
                 minImageCount = min(minImageCount, surfaceCapabilities.maxImageCount);
             createInfo.minImageCount = minImageCount;
         }
     }
 
-    deviceData->currentPresentMode = createInfo.presentMode;
-    deviceData->presentModeChanged = false;
+    swapchainData->presentMode = createInfo.presentMode;
 
-    return deviceData->createSwapchainKHR(device, &createInfo, pAllocator, pSwapchain);
-}
-#ifdef SW
-static void vkCmdDraw(VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance)
-{
-    // This function must never be called if "g_config.isSw" is "false"
+    auto ret = deviceData->createSwapchainKHR(device, &createInfo, pAllocator, pSwapchain);
+    if (ret != VK_SUCCESS)
+        return ret;
 
+    if (deviceData->getSwapchainImagesKHR)
+        deviceData->getSwapchainImagesKHR(device, *pSwapchain, &swapchainData->imageCount, nullptr);
+
+    if (config->autoFramerate || config->adaptiveFramerate)
     {
-        const pthread_t currThr = pthread_self();
-        scoped_lock locker(g_drawInfoMutex);
-        if (g_drawThr == 0)
+        // Queried for every swapchain, so the framerate follows the output the window is on
+        swapchainData->refreshRate = config->refreshRate;
+        if (deviceData->displayTiming && deviceData->getRefreshCycleDurationGOOGLE)
         {
-            char name[16];
-            if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0 && strcmp(name, "dxvk-cs") == 0)
-                g_drawThr = currThr;
+            VkRefreshCycleDurationGOOGLE refreshCycleDuration = {};
+            if (deviceData->getRefreshCycleDurationGOOGLE(device, *pSwapchain, &refreshCycleDuration) == VK_SUCCESS && refreshCycleDuration.refreshDuration > 0)
+                swapchainData->refreshRate = 1e9 / refreshCycleDuration.refreshDuration;
         }
-        if (g_drawThr == currThr)
+    }
+    if (config->autoFramerate)
+        swapchainData->autoFramerate = getAutoFramerate(*config, swapchainData->refreshRate);
+
+    if (config->maxFramesInFlight > 0)
+        createFrameFences(deviceData, swapchainData.get(), config->maxFramesInFlight);
+
+    scoped_lock devicesLock(g_devicesMutex);
+
+    if (!deviceData->swapchainsDispatch.insert(*pSwapchain, swapchainData.get()))
+    {
+        cerr << VK_LAYER_FLIMES_NAME << " too many swapchains" << endl;
+        destroyFrameFences(deviceData, swapchainData.get());
+        deviceData->destroySwapchainKHR(device, *pSwapchain, pAllocator);
+        *pSwapchain = VK_NULL_HANDLE;
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    // The config might have changed during the driver call, "applyConfig()" doesn't see this swapchain yet
+    if (swapchainSettingsDiffer(*config, *g_config.get()) || presentMode != getPresentMode(*g_config.get()))
+        swapchainData->presentModeChanged = true;
+
+    if (config->autoFramerate && deviceData->lastAutoFramerate != swapchainData->autoFramerate)
+    {
+        deviceData->lastAutoFramerate = swapchainData->autoFramerate;
+        cerr << VK_LAYER_FLIMES_NAME << " auto framerate: " << swapchainData->autoFramerate << " (refresh rate: " << swapchainData->refreshRate << ")" << endl;
+    }
+
+    deviceData->swapchains[*pSwapchain] = move(swapchainData);
+
+    return ret;
+}
+static void VKAPI_CALL vkDestroySwapchainKHR(VkDevice device, VkSwapchainKHR swapchain, const VkAllocationCallbacks *pAllocator)
+{
+    auto deviceData = g_devicesDispatch.find(device);
+    if (!deviceData)
+        return;
+
+    shared_ptr<SwapchainData> swapchainData;
+    {
+        scoped_lock devicesLock(g_devicesMutex);
+
+        if (auto swapchainsIt = deviceData->swapchains.find(swapchain); swapchainsIt != deviceData->swapchains.end())
         {
-            g_drawInfo.first += 1;
-            g_drawInfo.second += vertexCount;
+            swapchainData = move(swapchainsIt->second);
+            deviceData->swapchainsDispatch.erase(swapchain);
+            deviceData->swapchains.erase(swapchainsIt);
         }
     }
 
-    shared_lock devicesLock(g_devicesMutex);
+    // The swapchain can't be used by other threads here (Vulkan requires external synchronization)
+    if (swapchainData)
+    {
+        if (g_printStats)
+            printStats(swapchain, swapchainData.get());
+        if (g_telemetry)
+            g_telemetry->release(swapchainData.get());
 
-    if (g_devices.size() != 1)
-        return;
+        destroyFrameFences(deviceData, swapchainData.get());
+    }
 
-    g_devices.begin()->second->cmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+    deviceData->destroySwapchainKHR(device, swapchain, pAllocator);
+}
+// Draw counter hooks, returned from "vkGet*ProcAddr" only when draw counters are enabled
+static void VKAPI_CALL vkCmdDraw(VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance)
+{
+    DrawCounters::addDraw(vertexCount);
+    g_devicesDispatch.find(commandBuffer)->cmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+}
+static void VKAPI_CALL vkCmdDrawIndexed(VkCommandBuffer commandBuffer, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance)
+{
+    DrawCounters::addDraw(indexCount);
+    g_devicesDispatch.find(commandBuffer)->cmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+}
+static void VKAPI_CALL vkCmdDrawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride)
+{
+    DrawCounters::addIndirectDraw();
+    g_devicesDispatch.find(commandBuffer)->cmdDrawIndirect(commandBuffer, buffer, offset, drawCount, stride);
+}
+static void VKAPI_CALL vkCmdDrawIndexedIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride)
+{
+    DrawCounters::addIndirectDraw();
+    g_devicesDispatch.find(commandBuffer)->cmdDrawIndexedIndirect(commandBuffer, buffer, offset, drawCount, stride);
+}
+static void VKAPI_CALL vkCmdDrawIndirectCount(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride)
+{
+    DrawCounters::addIndirectDraw();
+    g_devicesDispatch.find(commandBuffer)->cmdDrawIndirectCount(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+}
+static void VKAPI_CALL vkCmdDrawIndirectCountKHR(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride)
+{
+    DrawCounters::addIndirectDraw();
+    g_devicesDispatch.find(commandBuffer)->cmdDrawIndirectCountKHR(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+}
+static void VKAPI_CALL vkCmdDrawIndexedIndirectCount(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride)
+{
+    DrawCounters::addIndirectDraw();
+    g_devicesDispatch.find(commandBuffer)->cmdDrawIndexedIndirectCount(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+}
+static void VKAPI_CALL vkCmdDrawIndexedIndirectCountKHR(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride)
+{
+    DrawCounters::addIndirectDraw();
+    g_devicesDispatch.find(commandBuffer)->cmdDrawIndexedIndirectCountKHR(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+}
+static void VKAPI_CALL vkCmdDispatch(VkCommandBuffer commandBuffer, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    DrawCounters::addDispatch();
+    g_devicesDispatch.find(commandBuffer)->cmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+}
+static void VKAPI_CALL vkCmdDispatchIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset)
+{
+    DrawCounters::addDispatch();
+    g_devicesDispatch.find(commandBuffer)->cmdDispatchIndirect(commandBuffer, buffer, offset);
+}
+// Load detector hooks, returned from "vkGet*ProcAddr" only when the load detector is enabled
+static VkResult VKAPI_CALL vkQueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo *pSubmits, VkFence fence)
+{
+    uint32_t commandBufferCount = 0;
+    for (uint32_t i = 0; i < submitCount; ++i)
+        commandBufferCount += pSubmits[i].commandBufferCount;
+    g_loadDetector->addSubmits(commandBufferCount);
+
+    return g_devicesDispatch.find(queue)->queueSubmit(queue, submitCount, pSubmits, fence);
+}
+static uint32_t getCommandBufferCount(uint32_t submitCount, const VkSubmitInfo2 *pSubmits)
+{
+    uint32_t commandBufferCount = 0;
+    for (uint32_t i = 0; i < submitCount; ++i)
+        commandBufferCount += pSubmits[i].commandBufferInfoCount;
+    return commandBufferCount;
+}
+static VkResult VKAPI_CALL vkQueueSubmit2(VkQueue queue, uint32_t submitCount, const VkSubmitInfo2 *pSubmits, VkFence fence)
+{
+    g_loadDetector->addSubmits(getCommandBufferCount(submitCount, pSubmits));
+
+    return g_devicesDispatch.find(queue)->queueSubmit2(queue, submitCount, pSubmits, fence);
+}
+static VkResult VKAPI_CALL vkQueueSubmit2KHR(VkQueue queue, uint32_t submitCount, const VkSubmitInfo2 *pSubmits, VkFence fence)
+{
+    g_loadDetector->addSubmits(getCommandBufferCount(submitCount, pSubmits));
+
+    return g_devicesDispatch.find(queue)->queueSubmit2KHR(queue, submitCount, pSubmits, fence);
 }
-#endif
 static VkResult VKAPI_CALL vkAcquireNextImageKHR(VkDevice device, VkSwapchainKHR swapchain, uint64_t timeout, VkSemaphore semaphore, VkFence fence, uint32_t *pImageIndex)
 {
-    return acquireNextImageCommon(device, [&](DeviceData *deviceData) {
+    return acquireNextImageCommon(device, swapchain, [&](DeviceData *deviceData) {
         return deviceData->acquireNextImageKHR(device, swapchain, timeout, semaphore, fence, pImageIndex);
     });
 }
 static VkResult VKAPI_CALL vkAcquireNextImage2KHR(VkDevice device, const VkAcquireNextImageInfoKHR *pAcquireInfo, uint32_t *pImageIndex)
 {
-    return acquireNextImageCommon(device, [&](DeviceData *deviceData) {
+    return acquireNextImageCommon(device, pAcquireInfo->swapchain, [&](DeviceData *deviceData) {
         return deviceData->acquireNextImage2KHR(device, pAcquireInfo, pImageIndex);
     });
 }
 static VkResult VKAPI_CALL vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR *pPresentInfo)
 {
-    shared_lock devicesLock(g_devicesMutex);
+    Tracer::Span span(Tracer::Name::QueuePresent);
 
-    auto queuesIt = g_queues.find(queue);
-    if (queuesIt == g_queues.end())
+    auto deviceData = g_devicesDispatch.find(queue);
+    if (!deviceData)
         return VK_ERROR_INITIALIZATION_FAILED;
 
-    auto deviceData = queuesIt->second.get();
-
     VkBaseOutStructure *backupNextPtr = nullptr;
     VkBaseOutStructure *backupStructPtr = nullptr;
 
-    if (g_config.presentMode || g_config.preferMailboxPresentMode)
+    auto config = g_config.get();
+    if (getPresentMode(*config) || config->preferMailboxPresentMode)
     {
         // Prevent setting present mode here when we have forced present mode.
         auto next = reinterpret_cast<VkBaseOutStructure *>(const_cast<void *>(pPresentInfo->pNext));
@@ -742,34 +2000,209 @@ static VkResult VKAPI_CALL vkQueuePresentKHR(VkQueue queue, const VkPresentInfoK
         }
     }
 
-    auto ret = deviceData->queuePresentKHR(queue, pPresentInfo);
+    auto presentInfo = *pPresentInfo;
+
+    // Present IDs for "vkWaitForPresentKHR", use application IDs if it provides them
+    const uint64_t *presentIds = nullptr;
+    VkPresentIdKHR presentIdInfo = {};
+    VkPresentIdKHR *appPresentIdInfo = nullptr;
+    bool restoreAppPresentIds = false; // the application structure without IDs is filled temporarily
+    uint64_t localPresentIds[4];
+    vector<uint64_t> heapPresentIds;
+    if (deviceData->presentWait)
+    {
+        for (auto next = reinterpret_cast<const VkBaseInStructure *>(presentInfo.pNext); next; next = next->pNext)
+        {
+            if (next->sType == VK_STRUCTURE_TYPE_PRESENT_ID_KHR)
+            {
+                appPresentIdInfo = reinterpret_cast<VkPresentIdKHR *>(const_cast<VkBaseInStructure *>(next));
+                presentIds = appPresentIdInfo->pPresentIds;
+                break;
+            }
+        }
+        if (!presentIds)
+        {
+            uint64_t *newPresentIds = localPresentIds;
+            if (presentInfo.swapchainCount > size(localPresentIds))
+            {
+                heapPresentIds.resize(presentInfo.swapchainCount);
+                newPresentIds = heapPresentIds.data();
+            }
+            for (uint32_t i = 0; i < presentInfo.swapchainCount; ++i)
+            {
+                // IDs of failed presents aren't reused
+                auto swapchainData = deviceData->swapchainsDispatch.find(presentInfo.pSwapchains[i]);
+                newPresentIds[i] = swapchainData ? swapchainData->lastPresentId + 1 : 0;
+            }
+            presentIds = newPresentIds;
+
+            if (appPresentIdInfo)
+            {
+                appPresentIdInfo->pPresentIds = presentIds;
+                restoreAppPresentIds = true;
+            }
+            else
+            {
+                presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+                presentIdInfo.pNext = presentInfo.pNext;
+                presentIdInfo.swapchainCount = presentInfo.swapchainCount;
+                presentIdInfo.pPresentIds = presentIds;
+                presentInfo.pNext = &presentIdInfo;
+            }
+        }
+        for (uint32_t i = 0; i < presentInfo.swapchainCount; ++i)
+        {
+            if (auto swapchainData = deviceData->swapchainsDispatch.find(presentInfo.pSwapchains[i]))
+                swapchainData->lastPresentId = max(swapchainData->lastPresentId, presentIds[i]);
+        }
+    }
+
+    // Time blocked in present isn't frame work for the predictive frame limiter and adaptive framerate
+    const bool measureBlocking = (config->limiterMode == Config::LimiterMode::Predictive || config->adaptiveFramerate);
+    const auto blockStartTime = measureBlocking ? FrameLimiter::frame_clock::now() : FrameLimiter::frame_clock::time_point();
+
+    bool presentSemaphoresChained = false;
+    for (uint32_t i = 0; i < presentInfo.swapchainCount; ++i)
+    {
+        auto swapchainData = deviceData->swapchainsDispatch.find(presentInfo.pSwapchains[i]);
+        if (!swapchainData || swapchainData->frameFences.empty())
+            continue;
+
+        // Once per present, before the fences
+        if (!presentSemaphoresChained)
+        {
+            chainPresentSemaphores(deviceData, queue, presentInfo, swapchainData, presentInfo.pImageIndices[i]);
+            presentSemaphoresChained = true;
+        }
+
+        submitFrameFence(deviceData, queue, swapchainData);
+    }
+
+    auto ret = deviceData->queuePresentKHR(queue, &presentInfo);
 
     if (backupStructPtr)
         backupStructPtr->pNext = backupNextPtr;
+    if (restoreAppPresentIds)
+        appPresentIdInfo->pPresentIds = nullptr;
+
+    const auto now = FrameLimiter::frame_clock::now();
+    bool limited = false;
+    for (uint32_t i = 0; i < pPresentInfo->swapchainCount; ++i)
+    {
+        auto swapchainData = deviceData->swapchainsDispatch.find(pPresentInfo->pSwapchains[i]);
+        if (!swapchainData)
+            continue;
+
+        const auto swapchainRet = pPresentInfo->pResults ? pPresentInfo->pResults[i] : ret;
+        if (swapchainRet != VK_SUCCESS && swapchainRet != VK_SUBOPTIMAL_KHR)
+        {
+            skipFrameStart(swapchainData);
+            continue;
+        }
+
+        if (measureBlocking)
+            swapchainData->blockedTime += now - blockStartTime;
+
+        // Loaded after the blocking calls
+        config = g_config.get();
+
+        if (presentIds && presentIds[i] > swapchainData->presentId)
+            swapchainData->presentId = presentIds[i];
+
+        const auto frame = swapchainData->stats.addFrame(now);
+        if (g_telemetry)
+        {
+            g_telemetry->publish(
+                swapchainData,
+                getFramerate(*config, swapchainData),
+                swapchainData->presentMode,
+                swapchainData->imageCount,
+                chrono::duration_cast<chrono::nanoseconds>(frame.frameTime).count(),
+                chrono::duration_cast<chrono::nanoseconds>(frame.sleepTime).count()
+            );
+        }
+        if (swapchainData->frameLog)
+        {
+            logFrame(swapchainData, pPresentInfo->pSwapchains[i], FrameLogFormat::Event::Present, now, frame.frameTime, frame.sleepTime);
+        }
+
+        if (g_loadDetector)
+        {
+            const auto counts = DrawCounters::collect(g_loadDetector->settings().threadName);
+            const auto frameCounts = counts - swapchainData->drawCounts;
+            swapchainData->drawCounts = counts;
+
+            auto &frameInfo = swapchainData->frameInfo;
+            frameInfo.draws = frameCounts.draws;
+            frameInfo.vertices = frameCounts.vertices;
+            frameInfo.dispatches = frameCounts.dispatches;
+            frameInfo.cpuTime = frame.frameTime - frame.sleepTime;
+        }
+
+        if (config->adaptiveFramerate && !swapchainData->loading)
+        {
+            auto &adaptiveFramerate = swapchainData->adaptiveFramerate;
+            const double maxFramerate = getMaxFramerate(*config, swapchainData);
+            if (adaptiveFramerate.maxFramerate() != maxFramerate)
+            {
+                // Start from the top step whenever the configured framerate changes
+                adaptiveFramerate.setMaxFramerate(maxFramerate, swapchainData->refreshRate);
+                swapchainData->framerateChanged = true;
+            }
+            else if (adaptiveFramerate.addFrame(max(frame.frameTime - frame.sleepTime - swapchainData->blockedTime, FrameLimiter::duration::zero())))
+            {
+                if (g_externalControlVerbose)
+                    cerr << VK_LAYER_FLIMES_NAME << " adaptive framerate: " << adaptiveFramerate.framerate() << endl;
+                swapchainData->framerateChanged = true;
+            }
+        }
+
+        if (config->limiterMode != Config::LimiterMode::Acquire && !swapchainData->loading && !limited)
+        {
+            // Sleep once per call, the first limited swapchain paces the others presented with it
+            limitFramerateAfterPresent(swapchainData, *config);
+            limited = true;
+        }
+        else
+        {
+            // The next frame work is measured from the next frame limiter wait
+            skipFrameStart(swapchainData);
+        }
+    }
 
     return ret;
 }
 static void VKAPI_CALL vkDestroyDevice(VkDevice device, const VkAllocationCallbacks *pAllocator)
 {
-    scoped_lock devicesLock(g_devicesMutex);
-
-    auto devicesIt = g_devices.find(device);
-    if (devicesIt == g_devices.end())
-        return;
+    shared_ptr<DeviceData> deviceData;
+    {
+        scoped_lock devicesLock(g_devicesMutex);
 
-    auto deviceData = devicesIt->second.get();
+        auto devicesIt = g_devices.find(device);
+        if (devicesIt == g_devices.end())
+            return;
 
-    deviceData->destroyDevice(device, pAllocator);
+        // No other thread can use the device here (Vulkan requires external synchronization),
+        // so it's destroyed after it's removed from the maps, without blocking other devices.
+        deviceData = move(devicesIt->second);
+        g_devicesDispatch.erase(device);
+        g_devices.erase(devicesIt);
+    }
 
-    for (auto it = g_queues.begin(); it != g_queues.end();)
+    for (auto &&[swapchain, swapchainData] : deviceData->swapchains)
     {
-        if (it->second.get() == deviceData)
-            it = g_queues.erase(it);
-        else
-            ++it;
+        if (g_printStats)
+            printStats(swapchain, swapchainData.get());
+        if (g_telemetry)
+            g_telemetry->release(swapchainData.get());
+        destroyFrameFences(deviceData.get(), swapchainData.get());
+    }
+    if (g_printStats && deviceData->samplerCache)
+    {
+        printSamplerCacheStats(device, deviceData.get());
     }
 
-    g_devices.erase(devicesIt);
+    deviceData->destroyDevice(device, pAllocator);
 }
 
 /**/
@@ -777,32 +2210,61 @@ static void VKAPI_CALL vkDestroyDevice(VkDevice device, const VkAllocationCallba
 extern "C" VK_LAYER_EXPORT PFN_vkVoidFunction VKAPI_CALL vkGetInstanceProcAddrFlimes(VkInstance instance, const char *pName);
 extern "C" VK_LAYER_EXPORT PFN_vkVoidFunction VKAPI_CALL vkGetDeviceProcAddrFlimes(VkDevice device, const char *pName);
 
-static const map<string_view, PFN_vkVoidFunction> g_instanceFunctions = {
-    {"vkGetInstanceProcAddr", reinterpret_cast<PFN_vkVoidFunction>(vkGetInstanceProcAddrFlimes)},
-    {"vkCreateInstance", reinterpret_cast<PFN_vkVoidFunction>(vkCreateInstance)},
-    {"vkCreateDevice", reinterpret_cast<PFN_vkVoidFunction>(vkCreateDevice)},
-    {"vkDestroyInstance", reinterpret_cast<PFN_vkVoidFunction>(vkDestroyInstance)},
-};
-static const map<string_view, PFN_vkVoidFunction> g_deviceFunctions = {
-    {"vkGetDeviceProcAddr", reinterpret_cast<PFN_vkVoidFunction>(vkGetDeviceProcAddrFlimes)},
-    {"vkCreateSampler", reinterpret_cast<PFN_vkVoidFunction>(vkCreateSampler)},
-#ifdef SW
-    {"vkCmdDraw", reinterpret_cast<PFN_vkVoidFunction>(vkCmdDraw)},
-#endif
-    {"vkCreateSwapchainKHR", reinterpret_cast<PFN_vkVoidFunction>(vkCreateSwapchainKHR)},
-    {"vkAcquireNextImageKHR", reinterpret_cast<PFN_vkVoidFunction>(vkAcquireNextImageKHR)},
-    {"vkAcquireNextImage2KHR", reinterpret_cast<PFN_vkVoidFunction>(vkAcquireNextImage2KHR)},
-    {"vkQueuePresentKHR", reinterpret_cast<PFN_vkVoidFunction>(vkQueuePresentKHR)},
-    {"vkDestroyDevice", reinterpret_cast<PFN_vkVoidFunction>(vkDestroyDevice)},
-};
+#include "DispatchHooks.inc"
+
+static constexpr ProcTable g_instanceFunctions(g_instanceHookNames);
+static constexpr ProcTable g_deviceFunctions(g_deviceHookNames);
+static_assert(g_instanceFunctions.isValid() && g_deviceFunctions.isValid());
+
+// Optional hooks are not returned when disabled, so they have no cost
+// "deviceData" is "nullptr" for device functions queried from "vkGetInstanceProcAddr"
+static bool isDeviceHookEnabled(const PFN_vkVoidFunction hook, const DeviceData *deviceData)
+{
+    static const PFN_vkVoidFunction drawCounterHooks[] = {
+        reinterpret_cast<PFN_vkVoidFunction>(vkCmdDraw),
+        reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndexed),
+        reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndirect),
+        reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndexedIndirect),
+        reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndirectCount),
+        reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndirectCountKHR),
+        reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndexedIndirectCount),
+        reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndexedIndirectCountKHR),
+        reinterpret_cast<PFN_vkVoidFunction>(vkCmdDispatch),
+        reinterpret_cast<PFN_vkVoidFunction>(vkCmdDispatchIndirect),
+    };
+
+    if (hook == reinterpret_cast<PFN_vkVoidFunction>(vkQueueSubmit))
+        return (g_loadDetector != nullptr);
+    // Provided only by Vulkan 1.3 or "VK_KHR_synchronization2", hooked only when the device has them
+    if (hook == reinterpret_cast<PFN_vkVoidFunction>(vkQueueSubmit2))
+        return (g_loadDetector && deviceData && deviceData->queueSubmit2);
+    if (hook == reinterpret_cast<PFN_vkVoidFunction>(vkQueueSubmit2KHR))
+        return (g_loadDetector && deviceData && deviceData->queueSubmit2KHR);
+    if (hook == reinterpret_cast<PFN_vkVoidFunction>(vkDestroySampler))
+        return g_samplerCache;
+    if (find(begin(drawCounterHooks), end(drawCounterHooks), hook) != end(drawCounterHooks) && !g_drawCounters)
+        return false;
+
+    // Provided only by Vulkan 1.2 or extensions, hooked only when the device has them
+    if (hook == reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndirectCount))
+        return (deviceData && deviceData->cmdDrawIndirectCount);
+    if (hook == reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndirectCountKHR))
+        return (deviceData && deviceData->cmdDrawIndirectCountKHR);
+    if (hook == reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndexedIndirectCount))
+        return (deviceData && deviceData->cmdDrawIndexedIndirectCount);
+    if (hook == reinterpret_cast<PFN_vkVoidFunction>(vkCmdDrawIndexedIndirectCountKHR))
+        return (deviceData && deviceData->cmdDrawIndexedIndirectCountKHR);
+
+    return true;
+}
 
 extern "C" VK_LAYER_EXPORT PFN_vkVoidFunction VKAPI_CALL vkGetInstanceProcAddrFlimes(VkInstance instance, const char *pName)
 {
-    if (auto fnsIt = g_instanceFunctions.find(pName); fnsIt != g_instanceFunctions.end())
-        return fnsIt->second;
+    if (auto idx = g_instanceFunctions.find(pName); idx > -1)
+        return g_instanceHooks[idx];
 
-    if (auto fnsIt = g_deviceFunctions.find(pName); fnsIt != g_deviceFunctions.end())
-        return fnsIt->second;
+    if (auto idx = g_deviceFunctions.find(pName); idx > -1 && isDeviceHookEnabled(g_deviceHooks[idx], nullptr))
+        return g_deviceHooks[idx];
 
     shared_lock instancesLock(g_instancesMutex);
 
@@ -814,19 +2276,13 @@ extern "C" VK_LAYER_EXPORT PFN_vkVoidFunction VKAPI_CALL vkGetInstanceProcAddrFl
 }
 extern "C" VK_LAYER_EXPORT PFN_vkVoidFunction VKAPI_CALL vkGetDeviceProcAddrFlimes(VkDevice device, const char *pName)
 {
-    if (auto fnsIt = g_deviceFunctions.find(pName); fnsIt != g_deviceFunctions.end())
-    {
-#ifdef SW
-        if (fnsIt->second != reinterpret_cast<PFN_vkVoidFunction>(vkCmdDraw) || g_config.isSw)
-#endif
-            return fnsIt->second;
-    }
+    auto deviceData = g_devicesDispatch.find(device);
 
-    shared_lock devicesLock(g_devicesMutex);
+    if (auto idx = g_deviceFunctions.find(pName); idx > -1 && isDeviceHookEnabled(g_deviceHooks[idx], deviceData))
+        return g_deviceHooks[idx];
 
-    auto devicesIt = g_devices.find(device);
-    if (devicesIt == g_devices.end())
+    if (!deviceData)
         return nullptr;
 
-    return devicesIt->second->getProcAddr(device, pName);
+    return deviceData->getProcAddr(device, pName);
 }
@@ -0,0 +1,233 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "LoadDetector.hpp"
+
+#include <iostream>
+#include <charconv>
+#include <cstring>
+
+using namespace std;
+
+// Learning of low-complexity frames
+constexpr uint32_t g_learnMaxComplexity = 16; // draws and dispatches
+constexpr uint32_t g_learnComplexityRatio = 8; // compared to normal frames
+constexpr uint32_t g_learnCpuTimeRatio = 2; // compared to normal frames, don't learn hitches
+constexpr uint32_t g_learnFrames = 30; // repeated signature
+constexpr uint32_t g_learnMinNormalFrames = 120;
+constexpr size_t g_maxLearnedSignatures = 8;
+constexpr double g_avgFactor = 1.0 / 64.0;
+
+bool LoadDetector::Signature::matches(const FrameInfo &info) const
+{
+    return
+        (!draws || *draws == info.draws) &&
+        (!vertices || *vertices == info.vertices) &&
+        (!dispatches || *dispatches == info.dispatches) &&
+        (!submits || *submits == info.submits)
+    ;
+}
+
+bool LoadDetector::parse(string_view str, Settings &settings)
+{
+    const auto trim = [](string_view s) {
+        while (!s.empty() && isspace(static_cast<unsigned char>(s.front())))
+            s.remove_prefix(1);
+        while (!s.empty() && isspace(static_cast<unsigned char>(s.back())))
+            s.remove_suffix(1);
+        return s;
+    };
+    const auto equals = [](string_view s, string_view lower) {
+        return (s.size() == lower.size() && strncasecmp(s.data(), lower.data(), s.size()) == 0);
+    };
+    const auto parseField = [](string_view s, optional<uint32_t> &value) {
+        if (s.empty() || s == "*")
+            return true;
+        uint32_t v = 0;
+        const auto [ptr, ec] = from_chars(s.data(), s.data() + s.size(), v);
+        if (ec != errc() || ptr != s.data() + s.size())
+            return false;
+        value = v;
+        return true;
+    };
+
+    while (!str.empty())
+    {
+        const auto pos = str.find(',');
+        const auto item = trim(str.substr(0, pos));
+        str = (pos == string_view::npos) ? string_view() : str.substr(pos + 1);
+
+        if (item.empty())
+            continue;
+
+        if (equals(item, "auto"))
+        {
+            settings.learn = true;
+            continue;
+        }
+        if (equals(item, "soulworker"))
+        {
+            // Loading screen draws on the DXVK command stream thread
+            for (auto &&[draws, vertices] : {pair(1u, 6u), pair(2u, 12u), pair(3u, 15u)})
+            {
+                Signature signature;
+                signature.draws = draws;
+                signature.vertices = vertices;
+                settings.signatures.push_back(signature);
+            }
+            if (settings.threadName.empty())
+                settings.threadName = "dxvk-cs";
+            continue;
+        }
+
+        Signature signature;
+        optional<uint32_t> *fields[] = {&signature.draws, &signature.vertices, &signature.dispatches, &signature.submits};
+        auto fieldsStr = item;
+        for (auto &&field : fields)
+        {
+            const auto fieldPos = fieldsStr.find('/');
+            if (!parseField(trim(fieldsStr.substr(0, fieldPos)), *field))
+                return false;
+            fieldsStr = (fieldPos == string_view::npos) ? string_view() : fieldsStr.substr(fieldPos + 1);
+            if (fieldPos == string_view::npos)
+                break;
+        }
+        if (!fieldsStr.empty())
+            return false;
+        settings.signatures.push_back(signature);
+    }
+
+    return (settings.learn || !settings.signatures.empty());
+}
+
+LoadDetector::LoadDetector(const Settings &settings)
+    : m_settings(settings)
+{
+}
+LoadDetector::~LoadDetector()
+{
+}
+
+void LoadDetector::addSubmits(const uint32_t count)
+{
+    m_submits.fetch_add(count, memory_order_relaxed);
+}
+
+bool LoadDetector::update(FrameInfo info, const time_point now)
+{
+    info.submits = m_submits.exchange(0, memory_order_relaxed);
+
+    scoped_lock locker(m_mutex);
+
+    if (isLoadFrame(info))
+    {
+        m_loading = true;
+        m_loadedTimePoint.reset();
+        return true;
+    }
+
+    if (m_loading)
+    {
+        m_loading = false;
+        m_loadedTimePoint = now;
+    }
+    if (m_loadedTimePoint)
+    {
+        if (now - *m_loadedTimePoint <= m_settings.releaseDelay)
+            return true;
+        m_loadedTimePoint.reset();
+    }
+
+    return false;
+}
+
+bool LoadDetector::isLoadFrame(const FrameInfo &info)
+{
+    for (auto &&signature : m_settings.signatures)
+    {
+        if (signature.matches(info))
+            return true;
+    }
+
+    if (!m_settings.learn)
+        return false;
+
+    for (auto &&signature : m_learned)
+    {
+        if (signature.matches(info))
+            return true;
+    }
+
+    // Loading screens are usually static and much simpler than the game frames
+    const uint32_t complexity = info.draws + info.dispatches;
+    const double cpuTime = info.cpuTime.count();
+    const bool lowComplexity =
+        m_normalFrames >= g_learnMinNormalFrames &&
+        complexity <= g_learnMaxComplexity &&
+        (complexity + 1) * g_learnComplexityRatio <= m_avgComplexity &&
+        cpuTime <= m_avgCpuTime * g_learnCpuTimeRatio
+    ;
+    if (!lowComplexity)
+    {
+        m_candidateFrames = 0;
+        m_normalFrames = min(m_normalFrames + 1, g_learnMinNormalFrames);
+        m_avgComplexity += (complexity - m_avgComplexity) * g_avgFactor;
+        m_avgCpuTime += (cpuTime - m_avgCpuTime) * g_avgFactor;
+        return false;
+    }
+
+    if (m_candidateFrames == 0 || info.draws != m_candidate.draws || info.vertices != m_candidate.vertices || info.dispatches != m_candidate.dispatches)
+    {
+        m_candidate = info;
+        m_candidateFrames = 1;
+        return false;
+    }
+    if (++m_candidateFrames < g_learnFrames || m_learned.size() >= g_maxLearnedSignatures)
+        return false;
+
+    Signature signature;
+    signature.draws = info.draws;
+    signature.vertices = info.vertices;
+    signature.dispatches = info.dispatches;
+    m_learned.push_back(signature);
+    m_candidateFrames = 0;
+
+    cerr << VK_LAYER_FLIMES_NAME << " learned loading screen signature: " << signature << endl;
+
+    return true;
+}
+
+ostream &operator<<(ostream &os, const LoadDetector::Signature &signature)
+{
+    const auto field = [&](const optional<uint32_t> &value) -> ostream & {
+        if (value)
+            return os << *value;
+        return os << "*";
+    };
+    field(signature.draws) << "/";
+    field(signature.vertices) << "/";
+    field(signature.dispatches) << "/";
+    field(signature.submits);
+    return os;
+}
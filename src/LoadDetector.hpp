@@ -0,0 +1,115 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include "FrameLimiter.hpp"
+
+#include <string_view>
+#include <optional>
+#include <iosfwd>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <mutex>
+
+// Detects loading screens from per-frame draw, dispatch and command buffer submission counts,
+// draws and dispatches are counted by "DrawCounters"
+class LoadDetector
+{
+public:
+    using duration = FrameLimiter::duration;
+    using time_point = FrameLimiter::frame_clock::time_point;
+
+    struct FrameInfo
+    {
+        uint32_t draws = 0;
+        uint32_t vertices = 0;
+        uint32_t dispatches = 0;
+        uint32_t submits = 0;
+        duration cpuTime = duration::zero();
+    };
+
+    // Empty fields match any value
+    struct Signature
+    {
+        std::optional<uint32_t> draws;
+        std::optional<uint32_t> vertices;
+        std::optional<uint32_t> dispatches;
+        std::optional<uint32_t> submits;
+
+        bool matches(const FrameInfo &info) const;
+    };
+
+    struct Settings
+    {
+        std::vector<Signature> signatures;
+        bool learn = false; // detect repeating low-complexity frames
+        std::string threadName; // count commands recorded on threads with this name only, all threads if empty
+        std::chrono::milliseconds releaseDelay = std::chrono::milliseconds(2000); // keep unlocked framerate after loading
+    };
+
+public:
+    // Parses comma-separated "draws/vertices/dispatches/submits" signatures ("*" or missing
+    // trailing fields match any value), "auto" enables learning, "soulworker" adds a preset
+    static bool parse(std::string_view str, Settings &settings);
+
+public:
+    LoadDetector(const Settings &settings);
+    ~LoadDetector();
+
+    inline const Settings &settings() const
+    {
+        return m_settings;
+    }
+
+    // Called from submitting threads
+    void addSubmits(const uint32_t count);
+
+    // Classifies the frame, submits are counted since the previous call, returns "true" while loading
+    bool update(FrameInfo info, const time_point now);
+
+private:
+    bool isLoadFrame(const FrameInfo &info);
+
+private:
+    const Settings m_settings;
+
+    std::atomic<uint32_t> m_submits {0};
+
+    std::mutex m_mutex;
+
+    bool m_loading = false;
+    std::optional<time_point> m_loadedTimePoint;
+
+    // Learning state
+    std::vector<Signature> m_learned;
+    FrameInfo m_candidate;
+    uint32_t m_candidateFrames = 0;
+    uint32_t m_normalFrames = 0;
+    double m_avgComplexity = 0.0;
+    double m_avgCpuTime = 0.0;
+};
+
+std::ostream &operator<<(std::ostream &os, const LoadDetector::Signature &signature);
@@ -0,0 +1,112 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+/*
+    Perfect hash table of function names, built at compile time.
+
+    The seed is searched until every name lands in a different slot,
+    so lookup is one hash and one string compare.
+*/
+template<size_t N>
+class ProcTable
+{
+    static constexpr size_t s_size = [] {
+        size_t size = 1;
+        while (size < N * 4)
+            size *= 2;
+        return size;
+    }();
+    static constexpr uint8_t s_emptySlot = 0xff;
+
+    static_assert(N < s_emptySlot, "Too many functions");
+
+public:
+    constexpr ProcTable(const std::string_view (&names)[N])
+        : m_names()
+        , m_slots()
+    {
+        for (size_t i = 0; i < N; ++i)
+            m_names[i] = names[i];
+
+        for (m_seed = 1; m_seed != 0; ++m_seed)
+        {
+            if (tryFill())
+                return;
+        }
+    }
+
+    constexpr bool isValid() const
+    {
+        return (m_seed != 0);
+    }
+
+    // Returns function index or -1
+    inline int find(const std::string_view name) const
+    {
+        const size_t idx = m_slots[hash(name, m_seed) & (s_size - 1)];
+        if (idx == s_emptySlot || m_names[idx] != name)
+            return -1;
+        return idx;
+    }
+
+private:
+    // FNV-1a
+    static constexpr uint32_t hash(const std::string_view str, const uint32_t seed)
+    {
+        uint32_t h = 2166136261u ^ seed;
+        for (auto &&c : str)
+        {
+            h ^= static_cast<uint8_t>(c);
+            h *= 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    constexpr bool tryFill()
+    {
+        for (auto &&slot : m_slots)
+            slot = s_emptySlot;
+
+        for (size_t i = 0; i < N; ++i)
+        {
+            auto &slot = m_slots[hash(m_names[i], m_seed) & (s_size - 1)];
+            if (slot != s_emptySlot)
+                return false;
+            slot = i;
+        }
+        return true;
+    }
+
+private:
+    std::array<std::string_view, N> m_names;
+    std::array<uint8_t, s_size> m_slots;
+    uint32_t m_seed = 0;
+};
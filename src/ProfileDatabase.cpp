@@ -0,0 +1,398 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "ProfileDatabase.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cctype>
+
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fnmatch.h>
+#include <fcntl.h>
+
+using namespace std;
+
+// Binary cache layout: header, profiles, settings, NUL-terminated strings (offsets are relative to the strings)
+namespace Cache {
+
+constexpr uint32_t Magic = 0x43504c46; // "FLPC"
+constexpr uint32_t Version = 1;
+
+struct Header
+{
+    uint32_t magic;
+    uint32_t version;
+    int64_t sourceMtime;
+    uint64_t sourceSize;
+    uint32_t sourcePath;
+    uint32_t nProfiles;
+    uint32_t nSettings;
+    uint32_t stringsSize;
+};
+struct Profile
+{
+    uint32_t pattern;
+    uint32_t firstSetting;
+    uint32_t nSettings;
+};
+struct Setting
+{
+    uint32_t key;
+    uint32_t value;
+};
+
+}
+
+static string_view trim(string_view str)
+{
+    while (!str.empty() && isspace(static_cast<unsigned char>(str.front())))
+        str.remove_prefix(1);
+    while (!str.empty() && isspace(static_cast<unsigned char>(str.back())))
+        str.remove_suffix(1);
+    return str;
+}
+
+static filesystem::path getXdgPath(const char *xdgEnv, const char *homeFallback)
+{
+    if (auto env = getenv(xdgEnv); env && *env == '/')
+        return env;
+    if (auto env = getenv("HOME"); env && *env)
+        return filesystem::path(env).append(homeFallback);
+    return {};
+}
+
+filesystem::path ProfileDatabase::getDefaultPath()
+{
+    auto path = getXdgPath("XDG_CONFIG_HOME", ".config");
+    if (path.empty())
+        return path;
+    return path.append(VK_LAYER_FLIMES_NAME).append("profiles.conf");
+}
+
+ProfileDatabase::ProfileDatabase(const filesystem::path &path, const string_view executableName)
+    : m_path(path)
+    , m_executableName(executableName)
+{
+    m_cachePath = getXdgPath("XDG_CACHE_HOME", ".cache");
+    if (!m_cachePath.empty())
+        m_cachePath.append(VK_LAYER_FLIMES_NAME).append("profiles.bin");
+}
+ProfileDatabase::~ProfileDatabase()
+{
+    if (m_inotifyFd > -1)
+        close(m_inotifyFd);
+}
+
+ProfileDatabase::Settings ProfileDatabase::load() const
+{
+    Settings settings;
+
+    struct stat st = {};
+    if (m_path.empty() || stat(m_path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return settings;
+
+    const int64_t mtime = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+    if (loadCache(mtime, st.st_size, settings))
+        return settings;
+
+    const auto profiles = parse();
+    writeCache(profiles, mtime, st.st_size);
+
+    for (auto &&profile : profiles)
+    {
+        if (fnmatch(profile.pattern.c_str(), m_executableName.c_str(), 0) == 0)
+            settings.insert(settings.end(), profile.settings.begin(), profile.settings.end());
+    }
+    return settings;
+}
+
+int ProfileDatabase::watch()
+{
+    if (m_inotifyFd > -1 || m_path.empty())
+        return m_inotifyFd;
+
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0)
+        return -1;
+
+    updateWatch();
+    if (m_watchFd < 0)
+    {
+        close(m_inotifyFd);
+        m_inotifyFd = -1;
+    }
+
+    return m_inotifyFd;
+}
+bool ProfileDatabase::updateWatch()
+{
+    // Watch the directory, because editors usually replace the file. If it doesn't exist yet,
+    // watch the nearest existing parent until the directories on the way are created.
+    const auto profileDir = m_path.parent_path();
+    auto dir = profileDir;
+    error_code e;
+    while (!filesystem::is_directory(dir, e) && dir.has_relative_path())
+        dir = dir.parent_path();
+
+    if (m_watchFd > -1 && dir == m_watchedDir)
+        return false;
+
+    if (m_watchFd > -1)
+        inotify_rm_watch(m_inotifyFd, m_watchFd);
+
+    const uint32_t mask = (dir == profileDir)
+        ? IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE
+        : IN_CREATE | IN_MOVED_TO
+    ;
+    m_watchFd = inotify_add_watch(m_inotifyFd, dir.c_str(), mask | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    m_watchedDir = (m_watchFd > -1) ? dir : filesystem::path();
+
+    return true;
+}
+bool ProfileDatabase::readChanges()
+{
+    const auto fileName = m_path.filename();
+    const bool watchingProfileDir = (m_watchedDir == m_path.parent_path());
+
+    bool changed = false;
+    bool rewatch = false;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t n;
+    while ((n = read(m_inotifyFd, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t i = 0; i < n;)
+        {
+            auto event = reinterpret_cast<const inotify_event *>(buffer + i);
+            if (event->wd == m_watchFd)
+            {
+                if (!watchingProfileDir || (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)))
+                    rewatch = true; // A directory on the way was created or the watched one removed
+                else if (event->len > 0 && fileName == event->name)
+                    changed = true;
+            }
+            i += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    // The file might have been created or removed with the directories
+    if (rewatch && updateWatch())
+        changed = true;
+
+    return changed;
+}
+
+bool ProfileDatabase::loadCache(const int64_t mtime, const uint64_t size, Settings &settings) const
+{
+    if (m_cachePath.empty())
+        return false;
+
+    const int fd = open(m_cachePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st = {};
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Cache::Header))
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    const auto fileSize = static_cast<size_t>(st.st_size);
+    const auto header = static_cast<const Cache::Header *>(data);
+    const Cache::Profile *profiles = nullptr;
+    const Cache::Setting *cacheSettings = nullptr;
+    const char *strings = nullptr;
+
+    auto isValid = [&] {
+        if (header->magic != Cache::Magic || header->version != Cache::Version)
+            return false;
+        if (header->sourceMtime != mtime || header->sourceSize != size)
+            return false;
+
+        const size_t expectedSize = sizeof(Cache::Header)
+            + sizeof(Cache::Profile) * static_cast<size_t>(header->nProfiles)
+            + sizeof(Cache::Setting) * static_cast<size_t>(header->nSettings)
+            + header->stringsSize
+        ;
+        if (fileSize != expectedSize || header->stringsSize == 0)
+            return false;
+
+        profiles = reinterpret_cast<const Cache::Profile *>(header + 1);
+        cacheSettings = reinterpret_cast<const Cache::Setting *>(profiles + header->nProfiles);
+        strings = reinterpret_cast<const char *>(cacheSettings + header->nSettings);
+        if (strings[header->stringsSize - 1] != '\0')
+            return false;
+
+        auto isString = [&](uint32_t offset) {
+            return offset < header->stringsSize;
+        };
+        if (!isString(header->sourcePath) || m_path.native() != strings + header->sourcePath)
+            return false;
+        for (uint32_t i = 0; i < header->nProfiles; ++i)
+        {
+            const auto &profile = profiles[i];
+            if (!isString(profile.pattern) || profile.firstSetting > header->nSettings || profile.nSettings > header->nSettings - profile.firstSetting)
+                return false;
+        }
+        for (uint32_t i = 0; i < header->nSettings; ++i)
+        {
+            if (!isString(cacheSettings[i].key) || !isString(cacheSettings[i].value))
+                return false;
+        }
+        return true;
+    };
+
+    const bool valid = isValid();
+    if (valid)
+    {
+        for (uint32_t i = 0; i < header->nProfiles; ++i)
+        {
+            const auto &profile = profiles[i];
+            if (fnmatch(strings + profile.pattern, m_executableName.c_str(), 0) != 0)
+                continue;
+
+            for (uint32_t s = profile.firstSetting; s < profile.firstSetting + profile.nSettings; ++s)
+                settings.emplace_back(strings + cacheSettings[s].key, strings + cacheSettings[s].value);
+        }
+    }
+
+    munmap(data, fileSize);
+    return valid;
+}
+void ProfileDatabase::writeCache(const vector<Profile> &profiles, const int64_t mtime, const uint64_t size) const
+{
+    if (m_cachePath.empty())
+        return;
+
+    string strings;
+    auto addString = [&](const string &str) {
+        const uint32_t offset = strings.size();
+        strings.append(str).push_back('\0');
+        return offset;
+    };
+
+    Cache::Header header = {};
+    header.magic = Cache::Magic;
+    header.version = Cache::Version;
+    header.sourceMtime = mtime;
+    header.sourceSize = size;
+    header.sourcePath = addString(m_path.native());
+    header.nProfiles = profiles.size();
+
+    vector<Cache::Profile> cacheProfiles;
+    vector<Cache::Setting> cacheSettings;
+    for (auto &&profile : profiles)
+    {
+        cacheProfiles.push_back({
+            .pattern = addString(profile.pattern),
+            .firstSetting = static_cast<uint32_t>(cacheSettings.size()),
+            .nSettings = static_cast<uint32_t>(profile.settings.size()),
+        });
+        for (auto &&[key, value] : profile.settings)
+        {
+            const auto keyOffset = addString(key);
+            cacheSettings.push_back({keyOffset, addString(value)});
+        }
+    }
+    header.nSettings = cacheSettings.size();
+    header.stringsSize = strings.size();
+
+    error_code e;
+    filesystem::create_directories(m_cachePath.parent_path(), e);
+
+    // Written to a temporary file and renamed, so other processes never see a partial cache
+    auto tmpPath = m_cachePath;
+    tmpPath.concat("." + to_string(getpid()));
+    {
+        ofstream f(tmpPath, ios::binary | ios::trunc);
+        f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        f.write(reinterpret_cast<const char *>(cacheProfiles.data()), cacheProfiles.size() * sizeof(Cache::Profile));
+        f.write(reinterpret_cast<const char *>(cacheSettings.data()), cacheSettings.size() * sizeof(Cache::Setting));
+        f.write(strings.data(), strings.size());
+        if (!f)
+        {
+            f.close();
+            filesystem::remove(tmpPath, e);
+            return;
+        }
+    }
+    filesystem::rename(tmpPath, m_cachePath, e);
+    if (e)
+        filesystem::remove(tmpPath, e);
+}
+
+vector<ProfileDatabase::Profile> ProfileDatabase::parse() const
+{
+    vector<Profile> profiles;
+
+    ifstream f(m_path);
+    string line;
+    uint32_t lineNumber = 0;
+    while (getline(f, line))
+    {
+        ++lineNumber;
+
+        const auto str = trim(line);
+        if (str.empty() || str[0] == '#' || str[0] == ';')
+            continue;
+
+        if (str.front() == '[')
+        {
+            if (str.back() != ']' || str.size() < 3)
+            {
+                cerr << "  " << m_path << ":" << lineNumber << ": invalid section" << "\n";
+                continue;
+            }
+            profiles.push_back({string(trim(str.substr(1, str.size() - 2))), {}});
+            continue;
+        }
+
+        const auto eq = str.find('=');
+        if (eq == string_view::npos)
+        {
+            cerr << "  " << m_path << ":" << lineNumber << ": expected \"key = value\"" << "\n";
+            continue;
+        }
+
+        string key;
+        for (auto c : trim(str.substr(0, eq)))
+            key.push_back(toupper(c));
+        if (constexpr string_view prefix = "VK_LAYER_FLIMES_"; key.compare(0, prefix.size(), prefix) == 0)
+            key.erase(0, prefix.size());
+
+        // Settings before the first section apply to all applications
+        if (profiles.empty())
+            profiles.push_back({"*", {}});
+
+        profiles.back().settings.emplace_back(move(key), string(trim(str.substr(eq + 1))));
+    }
+
+    return profiles;
+}
@@ -0,0 +1,95 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+#include <utility>
+#include <string>
+#include <vector>
+
+/*
+    Per-application settings from "~/.config/vk-layer-flimes/profiles.conf":
+
+        # Settings before the first section apply to all applications
+        FRAMERATE = 60
+
+        [*.exe]
+        PRESENT_MODE = mailbox
+
+        [SoulWorker*.exe]
+        FRAMERATE = 144
+
+    Section names are globs matched against the executable name, keys are environment variable
+    names with or without "VK_LAYER_FLIMES_" prefix. Matching sections apply in file order.
+
+    The file is parsed into a binary cache which is memory-mapped on next loads until the file
+    is modified.
+*/
+class ProfileDatabase
+{
+public:
+    using Settings = std::vector<std::pair<std::string, std::string>>; // upper-case key without prefix, value
+
+public:
+    // "$XDG_CONFIG_HOME/vk-layer-flimes/profiles.conf"
+    static std::filesystem::path getDefaultPath();
+
+public:
+    ProfileDatabase(const std::filesystem::path &path, const std::string_view executableName);
+    ~ProfileDatabase();
+
+    // Settings from all matching profiles, later ones take precedence
+    Settings load() const;
+
+    // Watches the profile directory or its nearest existing parent, returns inotify file descriptor or "-1"
+    int watch();
+    // Reads pending inotify events, returns "true" if the profile file has changed
+    bool readChanges();
+
+private:
+    struct Profile
+    {
+        std::string pattern;
+        Settings settings;
+    };
+
+    bool loadCache(const int64_t mtime, const uint64_t size, Settings &settings) const;
+    void writeCache(const std::vector<Profile> &profiles, const int64_t mtime, const uint64_t size) const;
+
+    std::vector<Profile> parse() const;
+
+    bool updateWatch();
+
+private:
+    const std::filesystem::path m_path;
+    const std::string m_executableName;
+
+    std::filesystem::path m_cachePath;
+
+    int m_inotifyFd = -1;
+    int m_watchFd = -1;
+    std::filesystem::path m_watchedDir;
+};
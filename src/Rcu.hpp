@@ -0,0 +1,65 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <utility>
+#include <atomic>
+#include <vector>
+
+/*
+    Read-copy-update publisher of immutable values.
+
+    Readers get the current value with a single acquire load and never block. Readers don't announce
+    when they stop using a value, so replaced values are never freed - they stay valid for the process
+    lifetime and the memory grows with every publish. Publish only on user changes, not on values which
+    change automatically. Publishers must be serialized by the caller.
+*/
+template<typename T>
+class Rcu
+{
+public:
+    explicit Rcu(T value)
+        : m_current(new T(std::move(value)))
+    {}
+    // Values are not freed at exit, other threads may still use them
+    ~Rcu() = default;
+
+    Rcu(const Rcu &) = delete;
+    Rcu &operator =(const Rcu &) = delete;
+
+    inline const T *get() const
+    {
+        return m_current.load(std::memory_order_acquire);
+    }
+
+    void publish(T value)
+    {
+        m_retired.push_back(m_current.exchange(new T(std::move(value)), std::memory_order_acq_rel));
+    }
+
+private:
+    std::atomic<const T *> m_current;
+    std::vector<const T *> m_retired; // still reachable for readers
+};
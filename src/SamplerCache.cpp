@@ -0,0 +1,122 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "SamplerCache.hpp"
+
+using namespace std;
+
+template<typename T>
+static inline void append(string &key, const T &value)
+{
+    key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Fields are appended one by one, so padding bytes are never a part of the key
+optional<string> SamplerCache::makeKey(const VkSamplerCreateInfo &createInfo)
+{
+    string key;
+    key.reserve(128);
+
+    append(key, createInfo.flags);
+    append(key, createInfo.magFilter);
+    append(key, createInfo.minFilter);
+    append(key, createInfo.mipmapMode);
+    append(key, createInfo.addressModeU);
+    append(key, createInfo.addressModeV);
+    append(key, createInfo.addressModeW);
+    append(key, createInfo.mipLodBias);
+    append(key, createInfo.anisotropyEnable);
+    append(key, createInfo.maxAnisotropy);
+    append(key, createInfo.compareEnable);
+    append(key, createInfo.compareOp);
+    append(key, createInfo.minLod);
+    append(key, createInfo.maxLod);
+    append(key, createInfo.borderColor);
+    append(key, createInfo.unnormalizedCoordinates);
+
+    for (auto next = static_cast<const VkBaseInStructure *>(createInfo.pNext); next; next = next->pNext)
+    {
+        append(key, next->sType);
+        switch (next->sType)
+        {
+            case VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO:
+            {
+                auto info = reinterpret_cast<const VkSamplerReductionModeCreateInfo *>(next);
+                append(key, info->reductionMode);
+                break;
+            }
+            case VK_STRUCTURE_TYPE_SAMPLER_CUSTOM_BORDER_COLOR_CREATE_INFO_EXT:
+            {
+                auto info = reinterpret_cast<const VkSamplerCustomBorderColorCreateInfoEXT *>(next);
+                append(key, info->customBorderColor);
+                append(key, info->format);
+                break;
+            }
+            case VK_STRUCTURE_TYPE_SAMPLER_BORDER_COLOR_COMPONENT_MAPPING_CREATE_INFO_EXT:
+            {
+                auto info = reinterpret_cast<const VkSamplerBorderColorComponentMappingCreateInfoEXT *>(next);
+                append(key, info->components);
+                append(key, info->srgb);
+                break;
+            }
+            default:
+                // Unknown structure, e.g. YCbCr conversion which refers to another object
+                return nullopt;
+        }
+    }
+
+    return key;
+}
+
+SamplerCache::Release SamplerCache::release(VkSampler sampler)
+{
+    scoped_lock locker(m_mutex);
+
+    auto samplersIt = m_samplers.find(sampler);
+    if (samplersIt == m_samplers.end())
+        return Release::NotCached;
+
+    auto entriesIt = m_entries.find(samplersIt->second);
+    if (--entriesIt->second.refs > 0)
+        return Release::Referenced;
+
+    m_entries.erase(entriesIt);
+    m_samplers.erase(samplersIt);
+    return Release::Destroy;
+}
+
+void SamplerCache::addBypassed()
+{
+    scoped_lock locker(m_mutex);
+    ++m_stats.bypassed;
+}
+
+SamplerCache::Stats SamplerCache::stats() const
+{
+    scoped_lock locker(m_mutex);
+
+    auto stats = m_stats;
+    stats.samplers = m_entries.size();
+    return stats;
+}
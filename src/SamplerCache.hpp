@@ -0,0 +1,100 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <vulkan/vk_layer.h>
+
+#include <unordered_map>
+#include <optional>
+#include <cstdint>
+#include <string>
+#include <mutex>
+
+// Shares samplers created from identical create infos, reference counted
+class SamplerCache
+{
+public:
+    struct Stats
+    {
+        uint64_t requests = 0; // cacheable "vkCreateSampler" calls
+        uint64_t hits = 0;
+        uint64_t bypassed = 0; // custom allocator or unknown "pNext" structure
+        size_t samplers = 0; // live unique samplers
+    };
+
+    enum class Release
+    {
+        NotCached,
+        Referenced, // other references remain
+        Destroy, // last reference, the sampler must be destroyed
+    };
+
+public:
+    // Returns the serialized create info including recognized "pNext" structures, "nullopt" if it can't be shared
+    static std::optional<std::string> makeKey(const VkSamplerCreateInfo &createInfo);
+
+    // Returns the shared sampler, calls "create" on miss
+    template<typename Fn>
+    VkResult acquire(std::string &&key, VkSampler *sampler, Fn &&create)
+    {
+        std::scoped_lock locker(m_mutex);
+
+        ++m_stats.requests;
+
+        if (auto it = m_entries.find(key); it != m_entries.end())
+        {
+            ++m_stats.hits;
+            ++it->second.refs;
+            *sampler = it->second.sampler;
+            return VK_SUCCESS;
+        }
+
+        const auto ret = create(sampler);
+        if (ret != VK_SUCCESS)
+            return ret;
+
+        m_samplers.emplace(*sampler, key);
+        m_entries.emplace(std::move(key), Entry{*sampler, 1});
+        return ret;
+    }
+
+    Release release(VkSampler sampler);
+
+    void addBypassed();
+
+    Stats stats() const;
+
+private:
+    struct Entry
+    {
+        VkSampler sampler;
+        uint32_t refs;
+    };
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::unordered_map<VkSampler, std::string> m_samplers;
+    Stats m_stats;
+};
@@ -0,0 +1,257 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "SamplerRules.hpp"
+
+#include <algorithm>
+#include <strings.h>
+#include <cstdlib>
+#include <cctype>
+#include <string>
+
+using namespace std;
+
+constexpr float g_mipmappedMinLod = 0.25f; // "maxLod" of non-mipmapped samplers is "0" or "0.25"
+
+static string_view trim(string_view str)
+{
+    while (!str.empty() && isspace(static_cast<unsigned char>(str.front())))
+        str.remove_prefix(1);
+    while (!str.empty() && isspace(static_cast<unsigned char>(str.back())))
+        str.remove_suffix(1);
+    return str;
+}
+
+static bool equals(const string_view a, const string_view b)
+{
+    return (a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0);
+}
+
+// Calls "fn(key, value)" for each comma-separated "key=value" item, stops when "fn" returns "false"
+template<typename Fn>
+static bool forEachItem(string_view str, Fn &&fn)
+{
+    while (!(str = trim(str)).empty())
+    {
+        const auto comma = str.find(',');
+        const auto item = str.substr(0, comma);
+        str = (comma == string_view::npos) ? string_view() : str.substr(comma + 1);
+
+        const auto eq = item.find('=');
+        if (eq == string_view::npos || !fn(trim(item.substr(0, eq)), trim(item.substr(eq + 1))))
+            return false;
+    }
+    return true;
+}
+
+static optional<bool> parseBool(const string_view str)
+{
+    if (str == "0")
+        return false;
+    if (str == "1")
+        return true;
+    return nullopt;
+}
+
+static optional<float> parseFloat(const string_view str)
+{
+    const string value(str);
+    char *end = nullptr;
+    const float number = strtof(value.c_str(), &end);
+    if (value.empty() || *end != '\0')
+        return nullopt;
+    return number;
+}
+
+/**/
+
+bool SamplerOverride::empty() const
+{
+    return (!filter && !mipLodBias && !maxAnisotropy);
+}
+
+void SamplerOverride::apply(VkSamplerCreateInfo &createInfo, float maxSamplerLodBias, float maxSamplerAnisotropy) const
+{
+    if (filter) switch (*filter)
+    {
+        case Filter::Nearest:
+            createInfo.magFilter = VK_FILTER_NEAREST;
+            createInfo.minFilter = VK_FILTER_NEAREST;
+            createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+            break;
+        case Filter::Trilinear:
+            createInfo.magFilter = VK_FILTER_LINEAR;
+            createInfo.minFilter = VK_FILTER_LINEAR;
+            createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+            break;
+    }
+    if (mipLodBias)
+    {
+        createInfo.mipLodBias = min(*mipLodBias, maxSamplerLodBias);
+    }
+    if (maxAnisotropy && *maxAnisotropy >= 1.0f)
+    {
+        createInfo.anisotropyEnable = VK_TRUE;
+        createInfo.maxAnisotropy = min(*maxAnisotropy, maxSamplerAnisotropy);
+    }
+    else if (maxAnisotropy)
+    {
+        createInfo.anisotropyEnable = VK_FALSE;
+    }
+}
+
+optional<SamplerOverride::Filter> SamplerOverride::parseFilter(const string_view str)
+{
+    if (equals(str, "nearest"))
+        return Filter::Nearest;
+    if (equals(str, "trilinear"))
+        return Filter::Trilinear;
+    return nullopt;
+}
+
+/**/
+
+bool SamplerRules::Condition::matches(const VkSamplerCreateInfo &createInfo) const
+{
+    if (compare && *compare != static_cast<bool>(createInfo.compareEnable))
+        return false;
+    if (unnormalized && *unnormalized != static_cast<bool>(createInfo.unnormalizedCoordinates))
+        return false;
+    if (mipmapped && *mipmapped != (createInfo.maxLod > g_mipmappedMinLod))
+        return false;
+    if (addressMode && (createInfo.addressModeU != *addressMode || createInfo.addressModeV != *addressMode))
+        return false;
+    if (filter && (createInfo.magFilter != *filter || createInfo.minFilter != *filter))
+        return false;
+    return true;
+}
+
+static bool parseCondition(const string_view key, const string_view value, SamplerRules::Condition &condition)
+{
+    constexpr pair<string_view, VkSamplerAddressMode> addressModes[] = {
+        {"repeat", VK_SAMPLER_ADDRESS_MODE_REPEAT},
+        {"mirrored_repeat", VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT},
+        {"clamp_to_edge", VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE},
+        {"clamp_to_border", VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER},
+        {"mirror_clamp_to_edge", VK_SAMPLER_ADDRESS_MODE_MIRROR_CLAMP_TO_EDGE},
+    };
+
+    if (equals(key, "compare"))
+        return (condition.compare = parseBool(value)).has_value();
+    if (equals(key, "unnormalized"))
+        return (condition.unnormalized = parseBool(value)).has_value();
+    if (equals(key, "mipmapped"))
+        return (condition.mipmapped = parseBool(value)).has_value();
+    if (equals(key, "address"))
+    {
+        for (auto &&[name, addressMode] : addressModes)
+        {
+            if (equals(value, name))
+            {
+                condition.addressMode = addressMode;
+                return true;
+            }
+        }
+        return false;
+    }
+    if (equals(key, "filter"))
+    {
+        if (equals(value, "nearest"))
+            condition.filter = VK_FILTER_NEAREST;
+        else if (equals(value, "linear"))
+            condition.filter = VK_FILTER_LINEAR;
+        else
+            return false;
+        return true;
+    }
+    return false;
+}
+static bool parseOverride(const string_view key, const string_view value, SamplerOverride &samplerOverride)
+{
+    if (equals(key, "filter"))
+        return (samplerOverride.filter = SamplerOverride::parseFilter(value)).has_value();
+    if (equals(key, "mip_lod_bias"))
+        return (samplerOverride.mipLodBias = parseFloat(value)).has_value();
+    if (equals(key, "max_anisotropy"))
+        return (samplerOverride.maxAnisotropy = parseFloat(value)).has_value();
+    return false;
+}
+static bool parseRule(const string_view str, SamplerRules::Rule &rule)
+{
+    const auto colon = str.find(':');
+    if (colon == string_view::npos)
+        return false;
+
+    auto conditions = trim(str.substr(0, colon));
+    if (conditions == "*")
+        conditions = {};
+
+    return
+        forEachItem(conditions, [&](auto key, auto value) {
+            return parseCondition(key, value, rule.condition);
+        }) &&
+        forEachItem(str.substr(colon + 1), [&](auto key, auto value) {
+            return parseOverride(key, value, rule.samplerOverride);
+        })
+    ;
+}
+
+bool SamplerRules::parse(string_view text, SamplerRules &rules, string_view &invalidRule)
+{
+    while (!text.empty())
+    {
+        const auto newLine = text.find('\n');
+        auto line = text.substr(0, newLine);
+        text = (newLine == string_view::npos) ? string_view() : text.substr(newLine + 1);
+
+        line = line.substr(0, line.find('#'));
+        while (!line.empty())
+        {
+            const auto semicolon = line.find(';');
+            const auto ruleStr = trim(line.substr(0, semicolon));
+            line = (semicolon == string_view::npos) ? string_view() : line.substr(semicolon + 1);
+            if (ruleStr.empty())
+                continue;
+
+            Rule rule;
+            if (!parseRule(ruleStr, rule))
+            {
+                invalidRule = ruleStr;
+                return false;
+            }
+            rules.m_rules.push_back(rule);
+        }
+    }
+    return true;
+}
+
+const SamplerOverride *SamplerRules::find(const VkSamplerCreateInfo &createInfo) const
+{
+    for (auto &&rule : m_rules)
+    {
+        if (rule.condition.matches(createInfo))
+            return &rule.samplerOverride;
+    }
+    return nullptr;
+}
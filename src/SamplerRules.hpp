@@ -0,0 +1,103 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <vulkan/vk_layer.h>
+
+#include <string_view>
+#include <optional>
+#include <vector>
+
+// Texture filtering settings forced on a sampler
+struct SamplerOverride
+{
+    enum class Filter
+    {
+        Nearest,
+        Trilinear,
+    };
+
+    std::optional<Filter> filter;
+    std::optional<float> mipLodBias;
+    std::optional<float> maxAnisotropy; // "0" disables anisotropic filtering
+
+    bool empty() const;
+
+    void apply(VkSamplerCreateInfo &createInfo, float maxSamplerLodBias, float maxSamplerAnisotropy) const;
+
+    static std::optional<Filter> parseFilter(std::string_view str);
+};
+
+/*
+    Selective sampler overrides, the first rule matching the application sampler is used.
+
+    Rule: "conditions:overrides", e.g. "compare=0,mipmapped=1:filter=trilinear,max_anisotropy=16"
+    Conditions ("*" or empty matches all samplers):
+        compare=0|1, unnormalized=0|1 - "compareEnable", "unnormalizedCoordinates"
+        mipmapped=0|1 - "maxLod" greater than 0.25
+        address=repeat|mirrored_repeat|clamp_to_edge|clamp_to_border|mirror_clamp_to_edge - U and V address modes
+        filter=nearest|linear - mag and min filters
+    Overrides (empty leaves the sampler unchanged):
+        filter=nearest|trilinear, mip_lod_bias=<float>, max_anisotropy=<float>
+*/
+class SamplerRules
+{
+public:
+    struct Condition
+    {
+        std::optional<bool> compare;
+        std::optional<bool> unnormalized;
+        std::optional<bool> mipmapped;
+        std::optional<VkSamplerAddressMode> addressMode;
+        std::optional<VkFilter> filter;
+
+        bool matches(const VkSamplerCreateInfo &createInfo) const;
+    };
+
+    struct Rule
+    {
+        Condition condition;
+        SamplerOverride samplerOverride;
+    };
+
+public:
+    // Rules are separated by ";" or new lines, "#" starts a comment till the end of line
+    static bool parse(std::string_view text, SamplerRules &rules, std::string_view &invalidRule);
+
+    inline bool empty() const
+    {
+        return m_rules.empty();
+    }
+    inline size_t size() const
+    {
+        return m_rules.size();
+    }
+
+    // Returns "nullptr" if no rule matches
+    const SamplerOverride *find(const VkSamplerCreateInfo &createInfo) const;
+
+private:
+    std::vector<Rule> m_rules;
+};
@@ -0,0 +1,76 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+// Wait-free single producer, single consumer ring buffer, "Size" must be a power of two
+template<typename T, size_t Size>
+class SpscRing
+{
+    static_assert(Size > 0 && (Size & (Size - 1)) == 0);
+
+public:
+    // Producer, returns "false" if the ring is full
+    bool push(const T &value)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tailCache >= Size)
+        {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head - m_tailCache >= Size)
+                return false;
+        }
+        m_items[head & (Size - 1)] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer, returns "false" if the ring is empty
+    bool pop(T &value)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_headCache)
+        {
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if (tail == m_headCache)
+                return false;
+        }
+        value = m_items[tail & (Size - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // Producer and consumer data on separate cache lines
+    alignas(64) std::atomic<size_t> m_head {0};
+    size_t m_tailCache = 0;
+
+    alignas(64) std::atomic<size_t> m_tail {0};
+    size_t m_headCache = 0;
+
+    alignas(64) T m_items[Size];
+};
@@ -0,0 +1,135 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "Telemetry.hpp"
+#include "ExternalControl.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+using namespace std;
+
+Telemetry::Telemetry()
+{
+    m_path = ExternalControl::getPath().concat(".shm");
+
+    error_code e;
+    filesystem::create_directories(m_path.parent_path(), e);
+    if (e)
+    {
+        cerr << "  Can't create telemetry directory: " << e << "\n";
+        return;
+    }
+
+    const int fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        cerr << "  Can't create telemetry file: " << m_path << "\n";
+        return;
+    }
+
+    if (ftruncate(fd, sizeof(TelemetryData)) == 0)
+    {
+        void *data = mmap(nullptr, sizeof(TelemetryData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED)
+            m_data = static_cast<TelemetryData *>(data);
+    }
+    close(fd);
+
+    if (!m_data)
+    {
+        cerr << "  Can't map telemetry file: " << m_path << "\n";
+        filesystem::remove(m_path, e);
+        return;
+    }
+
+    m_data->magic = TelemetryData::Magic;
+    m_data->version = TelemetryData::Version;
+    m_data->pid = getpid();
+    m_data->presentMode = -1;
+
+    cerr << "  Telemetry enabled: " << m_path << "\n";
+}
+Telemetry::~Telemetry()
+{
+    if (m_data)
+    {
+        munmap(m_data, sizeof(TelemetryData));
+
+        error_code e;
+        filesystem::remove(m_path, e);
+        filesystem::remove(m_path.parent_path(), e);
+    }
+}
+
+void Telemetry::publish(const void *swapchain, double framerate, int32_t presentMode, uint32_t imageCount, uint64_t frameTimeNs, uint64_t sleepNs)
+{
+    if (!m_data)
+        return;
+
+    const void *owner = nullptr;
+    if (!m_swapchain.compare_exchange_strong(owner, swapchain, memory_order_acquire) && owner != swapchain)
+        return;
+
+    m_pendingFrameTimesNs[m_pendingFrames % TelemetryData::FrameTimesSize] = frameTimeNs;
+    m_pendingFrames += 1;
+    m_pendingSleepNs += sleepNs;
+
+    uint32_t seq = m_data->seq.load(memory_order_relaxed);
+    if ((seq & 1) || !m_data->seq.compare_exchange_strong(seq, seq + 1, memory_order_acquire, memory_order_relaxed))
+        return;
+    atomic_thread_fence(memory_order_release);
+
+    m_data->framerate = framerate;
+    m_data->presentMode = presentMode;
+    m_data->imageCount = imageCount;
+    // Only the newest frame times fit
+    const uint64_t firstFrame = m_pendingFrames - min<uint64_t>(m_pendingFrames, TelemetryData::FrameTimesSize);
+    m_data->frames += firstFrame;
+    for (uint64_t i = firstFrame; i < m_pendingFrames; ++i)
+    {
+        m_data->frameTimesNs[m_data->frames % TelemetryData::FrameTimesSize] = m_pendingFrameTimesNs[i % TelemetryData::FrameTimesSize];
+        m_data->frames += 1;
+    }
+    m_data->sleepTotalNs += m_pendingSleepNs;
+
+    m_data->seq.store(seq + 2, memory_order_release);
+
+    m_pendingFrames = 0;
+    m_pendingSleepNs = 0;
+}
+void Telemetry::release(const void *swapchain)
+{
+    if (m_swapchain.load(memory_order_relaxed) != swapchain)
+        return;
+
+    // Frames which weren't published yet are lost
+    m_pendingFrames = 0;
+    m_pendingSleepNs = 0;
+    m_swapchain.store(nullptr, memory_order_release);
+}
@@ -0,0 +1,86 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <filesystem>
+#include <cstdint>
+#include <atomic>
+
+/*
+    Shared memory layout of "/tmp/vk-layer-flimes/name-pid.shm".
+
+    The layer is the only writer. Readers must use the seqlock protocol:
+    read "seq", skip if odd, copy the data, read "seq" again and retry if it changed.
+*/
+struct TelemetryData
+{
+    static constexpr uint32_t Magic = 0x534d4c46; // "FLMS"
+    static constexpr uint32_t Version = 1;
+    static constexpr uint32_t FrameTimesSize = 128;
+
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> seq;
+    uint32_t pid;
+
+    double framerate; // current framerate cap, 0 - unlimited
+    int32_t presentMode; // VkPresentModeKHR, -1 - unknown
+    uint32_t imageCount; // swapchain image count
+
+    uint64_t frames; // presented frames
+    uint64_t sleepTotalNs; // total time spent in the frame limiter
+    uint64_t frameTimesNs[FrameTimesSize]; // last frame times, the newest is at "(frames - 1) % FrameTimesSize"
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+class Telemetry
+{
+public:
+    Telemetry();
+    ~Telemetry();
+
+    inline bool isOpen() const
+    {
+        return (m_data != nullptr);
+    }
+
+    /*
+        Only the first swapchain which publishes is visible until it's released, the others are ignored.
+        Never blocks - if the segment is busy, the frame is kept and added by the next successful publish.
+    */
+    void publish(const void *swapchain, double framerate, int32_t presentMode, uint32_t imageCount, uint64_t frameTimeNs, uint64_t sleepNs);
+    void release(const void *swapchain);
+
+private:
+    std::filesystem::path m_path;
+
+    TelemetryData *m_data = nullptr;
+
+    // Owned by the publishing swapchain, presents to a swapchain are externally synchronized
+    std::atomic<const void *> m_swapchain = nullptr;
+    uint64_t m_pendingFrames = 0;
+    uint64_t m_pendingSleepNs = 0;
+    uint64_t m_pendingFrameTimesNs[TelemetryData::FrameTimesSize] = {};
+};
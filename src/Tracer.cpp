@@ -0,0 +1,234 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "Tracer.hpp"
+#include "ExecutableName.hpp"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+using namespace std;
+
+static mutex g_threadsMutex;
+
+// Never destroyed, "~Tracer()" runs after dynamically initialized statics are destroyed
+static vector<unique_ptr<Tracer::Thread>> &getThreads()
+{
+    static auto threads = new vector<unique_ptr<Tracer::Thread>>;
+    return *threads;
+}
+
+static const char *getEventName(const Tracer::Name name)
+{
+    switch (name)
+    {
+        case Tracer::Name::AcquireNextImage:
+            return "vkAcquireNextImageKHR";
+        case Tracer::Name::FrameLimiter:
+            return "FrameLimiter::wait";
+        case Tracer::Name::QueuePresent:
+            return "vkQueuePresentKHR";
+        case Tracer::Name::CreateSwapchain:
+            return "vkCreateSwapchainKHR";
+        case Tracer::Name::CreateSampler:
+            return "vkCreateSampler";
+    }
+    return "";
+}
+
+static void writeJsonString(FILE *file, const string_view str)
+{
+    fputc('"', file);
+    for (const char c : str)
+    {
+        if (c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if (static_cast<unsigned char>(c) < 0x20)
+            fprintf(file, "\\u%04x", c);
+        else
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+Tracer::Tracer(const filesystem::path &path)
+    : m_path(path)
+{}
+Tracer::~Tracer()
+{
+    stop();
+}
+
+bool Tracer::start()
+{
+    scoped_lock locker(m_mutex);
+
+    if (m_file)
+        return true;
+
+    // Drop spans which ended after the previous session was stopped
+    drain(false);
+
+    auto path = m_path;
+    if (m_session > 0)
+        path = m_path.parent_path() / m_path.stem().concat("-" + to_string(m_session + 1)).concat(m_path.extension().native());
+
+    if (path.has_parent_path())
+    {
+        error_code e;
+        filesystem::create_directories(path.parent_path(), e);
+    }
+
+    m_file = fopen(path.c_str(), "we");
+    if (!m_file)
+    {
+        cerr << VK_LAYER_FLIMES_NAME << " can't create trace file: " << path << endl;
+        return false;
+    }
+
+    ++m_session;
+
+    fprintf(m_file, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":", getpid());
+    writeJsonString(m_file, getExecutableName());
+    fputs("}}", m_file);
+
+    s_enabled = true;
+
+    cerr << VK_LAYER_FLIMES_NAME << " tracing to: " << path << endl;
+    return true;
+}
+void Tracer::stop()
+{
+    scoped_lock locker(m_mutex);
+
+    if (!m_file)
+        return;
+
+    s_enabled = false;
+
+    drain(true);
+
+    fputs("\n]\n", m_file);
+    fclose(m_file);
+    m_file = nullptr;
+
+    cerr << VK_LAYER_FLIMES_NAME << " tracing stopped" << endl;
+}
+
+void Tracer::flush()
+{
+    scoped_lock locker(m_mutex);
+
+    if (!m_file)
+        return;
+
+    drain(true);
+    fflush(m_file);
+}
+
+void Tracer::add(const Event &event)
+{
+    if (!t_thread)
+        t_thread = registerThread();
+    if (!t_thread->events.push(event))
+        t_thread->dropped.store(t_thread->dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+Tracer::Thread *Tracer::registerThread()
+{
+    // The thread buffer is released by "drain()" after the thread exits
+    struct ThreadExit
+    {
+        Thread *thread = nullptr;
+
+        ~ThreadExit()
+        {
+            thread->exited.store(true, memory_order_release);
+            t_thread = nullptr;
+        }
+    };
+
+    auto thread = make_unique<Thread>();
+    thread->tid = gettid();
+    pthread_getname_np(pthread_self(), thread->name, sizeof(thread->name));
+
+    thread_local ThreadExit threadExit;
+    threadExit.thread = thread.get();
+
+    scoped_lock locker(g_threadsMutex);
+    return getThreads().emplace_back(move(thread)).get();
+}
+
+// "m_mutex" must be locked
+void Tracer::drain(bool write)
+{
+    const int pid = getpid();
+
+    scoped_lock locker(g_threadsMutex);
+    auto &threads = getThreads();
+    for (auto it = threads.begin(); it != threads.end();)
+    {
+        auto thread = it->get();
+        const bool exited = thread->exited.load(memory_order_acquire);
+
+        Event event;
+        while (thread->events.pop(event))
+        {
+            if (!write)
+                continue;
+
+            if (thread->session != m_session)
+            {
+                thread->session = m_session;
+                fprintf(m_file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":", pid, thread->tid);
+                writeJsonString(m_file, thread->name);
+                fputs("}}", m_file);
+            }
+
+            fprintf(m_file, ",\n{\"name\":\"%s\",\"cat\":\"" VK_LAYER_FLIMES_NAME "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                getEventName(event.name),
+                event.beginNs / 1e3,
+                (event.endNs - event.beginNs) / 1e3,
+                pid,
+                thread->tid
+            );
+        }
+
+        if (const auto dropped = thread->dropped.load(memory_order_relaxed); dropped != thread->reportedDropped)
+        {
+            if (write)
+                cerr << VK_LAYER_FLIMES_NAME << " trace: " << dropped - thread->reportedDropped << " spans dropped on thread " << thread->tid << endl;
+            thread->reportedDropped = dropped;
+        }
+
+        if (exited)
+            it = threads.erase(it);
+        else
+            ++it;
+    }
+}
@@ -0,0 +1,130 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include "SpscRing.hpp"
+
+#include <filesystem>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+/*
+    Chrome JSON trace of the intercepted entry points, opens in "ui.perfetto.dev" or "chrome://tracing".
+
+    Spans are recorded into per-thread rings, "flush()" moves them to the trace file.
+*/
+class Tracer
+{
+public:
+    enum class Name : uint8_t
+    {
+        AcquireNextImage,
+        FrameLimiter,
+        QueuePresent,
+        CreateSwapchain,
+        CreateSampler,
+    };
+
+    struct Event
+    {
+        uint64_t beginNs;
+        uint64_t endNs;
+        Name name;
+    };
+
+    struct Thread
+    {
+        SpscRing<Event, 4096> events;
+        std::atomic<uint64_t> dropped {0};
+        std::atomic<bool> exited {false};
+        uint32_t tid = 0;
+        uint32_t session = 0; // last session with the thread name written, used by "drain()" only
+        uint64_t reportedDropped = 0; // used by "drain()" only
+        char name[16] = {};
+    };
+
+    // Records the scope duration when tracing is enabled
+    class Span
+    {
+    public:
+        inline Span(const Name name)
+            : m_name(name)
+            , m_beginNs(isEnabled() ? now() : 0)
+        {}
+        inline ~Span()
+        {
+            if (m_beginNs != 0)
+                add({m_beginNs, now(), m_name});
+        }
+
+        Span(const Span &) = delete;
+        Span &operator =(const Span &) = delete;
+
+    private:
+        const Name m_name;
+        const uint64_t m_beginNs;
+    };
+
+public:
+    // Sessions after the first one get "-N" suffix
+    Tracer(const std::filesystem::path &path);
+    ~Tracer();
+
+    static inline bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    bool start();
+    void stop();
+
+    // Writes recorded spans to the trace file
+    void flush();
+
+private:
+    static inline uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void add(const Event &event);
+
+    static Thread *registerThread();
+
+    void drain(bool write);
+
+private:
+    static inline std::atomic<bool> s_enabled = false;
+    static inline thread_local Thread *t_thread = nullptr;
+
+    const std::filesystem::path m_path;
+
+    std::mutex m_mutex;
+    FILE *m_file = nullptr;
+    uint32_t m_session = 0;
+};
@@ -0,0 +1,365 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "../src/CoordinatorProtocol.hpp"
+
+#include <filesystem>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <limits>
+#include <cmath>
+
+#include <sys/socket.h>
+#include <sys/poll.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <signal.h>
+
+using namespace std;
+
+/*
+    Host-wide frame budget coordinator.
+
+    Layers started with "VK_LAYER_FLIMES_COORDINATOR=<weight>" connect to this daemon and report
+    their framerate and frame cost every second. The framerate budget is shared using weighted
+    max-min fairness: every process gets a share proportional to its weight, processes which
+    can't use their share (frame cost too high, or idle) get what they can use and the rest is
+    split among others.
+*/
+
+struct Options
+{
+    double budget = 0.0;
+    double minFps = 10.0;
+    double maxFps = 1000.0;
+    double headroom = 1.1; // demand is the framerate possible at the measured frame cost multiplied by this
+    filesystem::path socketPath;
+    bool verbose = false;
+};
+
+struct Client
+{
+    int fd = -1;
+
+    pid_t pid = 0;
+    string name;
+    double weight = 1.0;
+
+    bool reported = false;
+    double fps = 0.0;
+    double frameCostUs = 0.0;
+
+    double cap = 0.0; // last sent
+};
+
+static volatile sig_atomic_t g_quit = false;
+
+static double getDemand(const Client &client, const Options &options)
+{
+    if (!client.reported)
+        return options.maxFps;
+    if (client.fps <= 0.0)
+        return options.minFps; // idle
+    if (client.frameCostUs <= 0.0)
+        return options.maxFps;
+    return clamp(1e6 / client.frameCostUs * options.headroom, options.minFps, options.maxFps);
+}
+
+static vector<double> allocate(const vector<Client> &clients, const Options &options)
+{
+    vector<double> caps(clients.size(), 0.0);
+    vector<double> demands(clients.size());
+    vector<size_t> active;
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+        demands[i] = getDemand(clients[i], options);
+        active.push_back(i);
+    }
+
+    // Water-filling: satisfy clients which demand less than their weighted share, repeat for the rest
+    double remaining = options.budget;
+    while (!active.empty())
+    {
+        double weightSum = 0.0;
+        for (auto i : active)
+            weightSum += clients[i].weight;
+
+        vector<size_t> unsatisfied;
+        double used = 0.0;
+        for (auto i : active)
+        {
+            const double share = remaining * clients[i].weight / weightSum;
+            if (demands[i] <= share)
+            {
+                caps[i] = demands[i];
+                used += demands[i];
+            }
+            else
+            {
+                unsatisfied.push_back(i);
+            }
+        }
+
+        if (unsatisfied.size() == active.size())
+        {
+            for (auto i : active)
+                caps[i] = remaining * clients[i].weight / weightSum;
+            break;
+        }
+
+        remaining -= used;
+        active = move(unsatisfied);
+    }
+
+    double sum = 0.0;
+    double reducible = 0.0;
+    for (auto &&cap : caps)
+    {
+        cap = clamp(cap, options.minFps, options.maxFps);
+        sum += cap;
+        reducible += cap - options.minFps;
+    }
+
+    // Caps raised to the minimum are taken from the others proportionally to what they have above it,
+    // the budget is exceeded only when the minimum for every process doesn't fit into it
+    if (const double excess = sum - options.budget; excess > 0.0 && reducible > 0.0)
+    {
+        const double scale = max(1.0 - excess / reducible, 0.0);
+        for (auto &&cap : caps)
+            cap = options.minFps + (cap - options.minFps) * scale;
+    }
+
+    return caps;
+}
+
+static void rebalance(vector<Client> &clients, const Options &options)
+{
+    const auto caps = allocate(clients, options);
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+        auto &client = clients[i];
+        if (abs(caps[i] - client.cap) < 0.5)
+            continue;
+
+        const auto message = "CAP " + to_string(caps[i]);
+        if (send(client.fd, message.data(), message.size(), MSG_NOSIGNAL | MSG_DONTWAIT) == static_cast<ssize_t>(message.size()))
+            client.cap = caps[i];
+    }
+
+    if (options.verbose)
+    {
+        cerr << fixed << setprecision(1);
+        for (auto &&client : clients)
+        {
+            cerr << "  " << client.name << " (" << client.pid << "), weight: " << client.weight;
+            cerr << ", fps: " << client.fps << ", frame cost: " << client.frameCostUs << " us, cap: " << client.cap << "\n";
+        }
+        cerr << "---" << endl;
+    }
+}
+
+static bool processMessage(Client &client, const char *message)
+{
+    char name[CoordinatorProtocol::MaxMessageSize] = {};
+    int pid = 0;
+    double a = 0.0, b = 0.0;
+
+    if (sscanf(message, "HELLO %d %lf %255s", &pid, &a, name) == 3)
+    {
+        client.pid = pid;
+        client.weight = max(a, 0.01);
+        client.name = name;
+        return true;
+    }
+    if (sscanf(message, "REPORT %lf %lf", &a, &b) == 2)
+    {
+        client.fps = a;
+        client.frameCostUs = b;
+        client.reported = true;
+        return false; // rebalanced periodically
+    }
+
+    return false;
+}
+
+static void printUsage(const char *name)
+{
+    cerr << "Usage: " << name << " --budget <fps> [options]" << endl;
+    cerr << "  --budget <fps>             total framerate shared by all processes" << endl;
+    cerr << "  --min-fps <fps>            minimum framerate cap (default: 10)" << endl;
+    cerr << "  --max-fps <fps>            maximum framerate cap (default: 1000)" << endl;
+    cerr << "  --headroom <ratio>         demand multiplier over the measured frame cost (default: 1.1)" << endl;
+    cerr << "  --socket <path>            socket path (default: /tmp/" << VK_LAYER_FLIMES_NAME << "/" << CoordinatorProtocol::SocketName << ")" << endl;
+    cerr << "  --verbose                  print allocations" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    options.socketPath = filesystem::temp_directory_path().append(VK_LAYER_FLIMES_NAME).append(CoordinatorProtocol::SocketName);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = (i + 1 < argc);
+        if (strcmp(argv[i], "--budget") == 0 && hasValue)
+            options.budget = atof(argv[++i]);
+        else if (strcmp(argv[i], "--min-fps") == 0 && hasValue)
+            options.minFps = max(1.0, atof(argv[++i]));
+        else if (strcmp(argv[i], "--max-fps") == 0 && hasValue)
+            options.maxFps = atof(argv[++i]);
+        else if (strcmp(argv[i], "--headroom") == 0 && hasValue)
+            options.headroom = max(1.0, atof(argv[++i]));
+        else if (strcmp(argv[i], "--socket") == 0 && hasValue)
+            options.socketPath = argv[++i];
+        else if (strcmp(argv[i], "--verbose") == 0)
+            options.verbose = true;
+        else
+            return printUsage(argv[0]), 1;
+    }
+    if (options.budget <= 0.0 || options.maxFps < options.minFps)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (options.socketPath.native().size() >= sizeof(addr.sun_path))
+    {
+        cerr << "Socket path is too long: " << options.socketPath << endl;
+        return 1;
+    }
+    strcpy(addr.sun_path, options.socketPath.c_str());
+
+    error_code e;
+    filesystem::create_directories(options.socketPath.parent_path(), e);
+
+    // Replace only a stale socket, not one of a running coordinator
+    if (const int probeFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0); probeFd > -1)
+    {
+        const bool running = (connect(probeFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+        close(probeFd);
+        if (running)
+        {
+            cerr << "Coordinator is already running on " << options.socketPath << endl;
+            return 1;
+        }
+    }
+
+    const int listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(options.socketPath.c_str());
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listenFd, 64) != 0)
+    {
+        cerr << "Can't listen on " << options.socketPath << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    chmod(options.socketPath.c_str(), 0600);
+
+    struct sigaction sa = {};
+    sa.sa_handler = [](int) {
+        g_quit = true;
+    };
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    cerr << "Coordinating " << options.budget << " FPS on " << options.socketPath << endl;
+
+    constexpr auto rebalanceInterval = chrono::seconds(1);
+    auto nextRebalance = chrono::steady_clock::now() + rebalanceInterval;
+
+    vector<Client> clients;
+    vector<pollfd> fds;
+    char buffer[CoordinatorProtocol::MaxMessageSize + 1];
+
+    while (!g_quit)
+    {
+        fds.clear();
+        fds.push_back({.fd = listenFd, .events = POLLIN, .revents = 0});
+        for (auto &&client : clients)
+            fds.push_back({.fd = client.fd, .events = POLLIN, .revents = 0});
+
+        const auto timeout = chrono::duration_cast<chrono::milliseconds>(nextRebalance - chrono::steady_clock::now()).count();
+        if (poll(fds.data(), fds.size(), max<int64_t>(timeout, 0)) < 0 && errno != EINTR)
+            break;
+
+        bool changed = false;
+
+        // Clients, iterated backwards so erasing doesn't shift unprocessed indexes
+        for (size_t i = clients.size(); i-- > 0;)
+        {
+            const auto revents = fds[i + 1].revents;
+            if (revents == 0)
+                continue;
+
+            const auto n = (revents & POLLIN) ? recv(clients[i].fd, buffer, CoordinatorProtocol::MaxMessageSize, 0) : 0;
+            if (n > 0)
+            {
+                buffer[n] = '\0';
+                changed |= processMessage(clients[i], buffer);
+            }
+            else if (n == 0 || (errno != EAGAIN && errno != EINTR))
+            {
+                if (options.verbose)
+                    cerr << "Disconnected: " << clients[i].name << " (" << clients[i].pid << ")" << endl;
+                close(clients[i].fd);
+                clients.erase(clients.begin() + i);
+                changed = true;
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd;
+            while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) > -1)
+            {
+                Client client;
+                client.fd = fd;
+                clients.push_back(move(client));
+            }
+        }
+
+        const auto now = chrono::steady_clock::now();
+        if (changed || now >= nextRebalance)
+        {
+            rebalance(clients, options);
+            if (now >= nextRebalance)
+                nextRebalance = now + rebalanceInterval;
+        }
+    }
+
+    for (auto &&client : clients)
+        close(client.fd);
+    close(listenFd);
+    unlink(options.socketPath.c_str());
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+    MIT License
+
+    Copyright (c) 2020-2021 Błażej Szczygieł
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "../src/FrameLogFormat.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <vector>
+
+using namespace std;
+
+/*
+    Converts binary frame logs written by "VK_LAYER_FLIMES_FRAME_LOG" to CSV.
+
+    Rotated files can be concatenated by passing them from the oldest one, e.g.
+    "flimes-log2csv app.flog.3 app.flog.2 app.flog.1 app.flog > app.csv".
+*/
+
+static void printUsage(const char *name)
+{
+    cerr << "Usage: " << name << " [options] <file>..." << endl;
+    cerr << "  -o <path>                  output file (default: stdout)" << endl;
+}
+
+static bool convert(const char *path, FILE *output)
+{
+    FILE *input = fopen(path, "rb");
+    if (!input)
+    {
+        cerr << "Can't open " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    bool ok = false;
+    FrameLogFormat::Header header = {};
+    if (fread(&header, sizeof(header), 1, input) != 1 || header.magic != FrameLogFormat::Header::Magic)
+        cerr << "Not a frame log: " << path << endl;
+    else if (header.version != FrameLogFormat::Header::Version || header.recordSize != sizeof(FrameLogFormat::Record))
+        cerr << "Unsupported frame log version " << header.version << ": " << path << endl;
+    else
+        ok = true;
+
+    vector<FrameLogFormat::Record> records(4096);
+    size_t n;
+    while (ok && (n = fread(records.data(), sizeof(FrameLogFormat::Record), records.size(), input)) > 0)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            char line[128];
+            if (FrameLogFormat::formatCsv(records[i], line, sizeof(line)) > 0)
+                fputs(line, output);
+        }
+    }
+
+    fclose(input);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outputPath = nullptr;
+    vector<const char *> inputPaths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (argv[i][0] == '-')
+            return printUsage(argv[0]), 1;
+        else
+            inputPaths.push_back(argv[i]);
+    }
+    if (inputPaths.empty())
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    FILE *output = outputPath ? fopen(outputPath, "w") : stdout;
+    if (!output)
+    {
+        cerr << "Can't create " << outputPath << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    fputs(FrameLogFormat::CsvHeader, output);
+
+    bool ok = true;
+    for (auto inputPath : inputPaths)
+        ok = convert(inputPath, output) && ok;
+
+    if (fclose(output) != 0)
+        ok = false;
+
+    return ok ? 0 : 1;
+}